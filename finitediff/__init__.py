@@ -8,14 +8,32 @@ from ._release import __version__
 
 from ._finitediff_c import (
     derivatives_at_point_by_finite_diff,
+    derivatives_at_points_by_finite_diff,
     interpolate_by_finite_diff,
+    differentiate_on_grid,
+    differentiate_function,
+    color_columns,
+    sparse_jacobian,
     get_weights,
+    get_weights_at_points,
+    write_weights_file,
+    MappedWeights,
+    MovingGridPlan,
 )
 
 __all__ = [
     "derivatives_at_point_by_finite_diff",
+    "derivatives_at_points_by_finite_diff",
     "interpolate_by_finite_diff",
+    "differentiate_on_grid",
+    "differentiate_function",
+    "color_columns",
+    "sparse_jacobian",
     "get_weights",
+    "get_weights_at_points",
+    "write_weights_file",
+    "MappedWeights",
+    "MovingGridPlan",
 ]
 
 
@@ -0,0 +1,19 @@
+# -*- coding: utf-8; mode: cython -*-
+# cython: language_level=3
+#
+# GIL-free entry points of finitediff._finitediff_c, usable from other Cython extensions:
+#
+#     from finitediff._finitediff_c cimport weights_at_points, derivatives_at_points
+#
+# Both return one of FINITEDIFF_STATUS_CODES (see finitediff_c.h), 0 on success.
+# ``engine`` is one of FINITEDIFF_WEIGHTS_ENGINE.
+
+cdef int weights_at_points(
+    double * out, int ld_tgt, int ld_deriv,
+    const double * grid, int len_grid, int max_deriv,
+    const double * xtgts, int len_targets, int engine) nogil
+
+cdef int derivatives_at_points(
+    double * out, int ld_tgt, int ld_set, int nsets, int max_deriv,
+    const double * grid, int len_grid, const double * ydata, int ldy,
+    const double * xtgts, int len_targets) nogil
@@ -3,13 +3,137 @@
 # cython: language_level=3
 
 cimport numpy as cnp
+from libc.stdlib cimport malloc, free
+import os
+import threading
 import numpy as np
 
 from newton_interval cimport get_interval, get_interval_from_guess
-from finitediff_c cimport finitediff_calc_and_apply_fd, finitediff_calculate_weights, finitediff_interpolate_by_finite_diff
+from finitediff_c cimport (
+    FINITEDIFF_STATUS_SUCCESS, FINITEDIFF_STATUS_ERR_BAD_ALLOC, FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID,
+    FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION, FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS,
+    FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR, FINITEDIFF_STATUS_ERR_UNKNOWN_LAYOUT,
+    FINITEDIFF_STATUS_ERR_IO, FINITEDIFF_STATUS_ERR_BAD_FORMAT, FINITEDIFF_STATUS_ERR_BAD_PERIOD,
+    FINITEDIFF_STATUS_ERR_CALLBACK, FINITEDIFF_STATUS_ERR_UNKNOWN_ENGINE, FINITEDIFF_STATUS_ERR_BAD_ARGUMENT,
+    FINITEDIFF_YDATA_SET_GRID, FINITEDIFF_YDATA_GRID_SET, FINITEDIFF_OUT_TGT_SET_DERIV,
+    FINITEDIFF_WEIGHTS_FORNBERG, FINITEDIFF_WEIGHTS_BARYCENTRIC,
+    finitediff_barycentric_weights, finitediff_calculate_weights_barycentric,
+    finitediff_apply_fd, finitediff_calc_and_apply_fd, finitediff_calculate_weights,
+    finitediff_interpolate_by_finite_diff_layout, finitediff_interpolate_periodic, finitediff_weights_view, finitediff_weights_write,
+    finitediff_weights_view_init, finitediff_apply_weights_view, finitediff_plan, finitediff_plan_create,
+    finitediff_plan_update, finitediff_plan_view, finitediff_plan_destroy, finitediff_differentiate_on_grid,
+    finitediff_differentiate_function, finitediff_color_columns, finitediff_sparse_jacobian
+)
 
 
-def get_weights(grid, double xtgt, int n=-1, int maxorder=0):
+cdef int weights_at_points(
+        double * out, int ld_tgt, int ld_deriv,
+        const double * grid, int len_grid, int max_deriv,
+        const double * xtgts, int len_targets, int engine) nogil:
+    # out[tgt_idx*ld_tgt + deriv_idx*ld_deriv + grid_idx]
+    cdef int tgt_idx
+    cdef double cap
+    cdef double * b
+    if len_grid < 1:  # orders above len_grid - 1 are not resolved by the grid and get zero weights
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID
+    if ld_deriv < len_grid:
+        return FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION
+    if engine == FINITEDIFF_WEIGHTS_BARYCENTRIC:
+        b = <double *>malloc(sizeof(double)*(len_grid + max_deriv + 1))
+        if b == NULL:
+            return FINITEDIFF_STATUS_ERR_BAD_ALLOC
+        cap = finitediff_barycentric_weights(b, grid, len_grid)  # once for all targets
+        for tgt_idx in range(len_targets):
+            finitediff_calculate_weights_barycentric(out + tgt_idx*ld_tgt, ld_deriv, grid, len_grid, max_deriv,
+                                                     xtgts[tgt_idx], b, cap, b + len_grid)
+        free(b)
+    elif engine == FINITEDIFF_WEIGHTS_FORNBERG:
+        for tgt_idx in range(len_targets):
+            finitediff_calculate_weights(out + tgt_idx*ld_tgt, ld_deriv, grid, len_grid, max_deriv, xtgts[tgt_idx])
+    else:
+        return FINITEDIFF_STATUS_ERR_UNKNOWN_ENGINE
+    return FINITEDIFF_STATUS_SUCCESS
+
+
+cdef int derivatives_at_points(
+        double * out, int ld_tgt, int ld_set, int nsets, int max_deriv,
+        const double * grid, int len_grid, const double * ydata, int ldy,
+        const double * xtgts, int len_targets) nogil:
+    # out[tgt_idx*ld_tgt + set_idx*ld_set + deriv_idx], ydata[set_idx*ldy + grid_idx]
+    cdef int tgt_idx
+    cdef double * w
+    if len_grid < max_deriv + 1:
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID
+    if ld_set < max_deriv + 1:
+        return FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION
+    w = <double *>malloc(sizeof(double)*len_grid*(max_deriv+1))
+    if w == NULL:
+        return FINITEDIFF_STATUS_ERR_BAD_ALLOC
+    for tgt_idx in range(len_targets):
+        finitediff_calculate_weights(w, len_grid, grid, len_grid, max_deriv, xtgts[tgt_idx])
+        finitediff_apply_fd(out + tgt_idx*ld_tgt, ld_set, w, len_grid, nsets, max_deriv, len_grid, ydata, ldy)
+    free(w)
+    return FINITEDIFF_STATUS_SUCCESS
+
+
+cdef _check_status(int flag):
+    if flag == FINITEDIFF_STATUS_ERR_BAD_ALLOC:
+        raise ValueError("Bad alloc")
+    elif flag == FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID:
+        raise ValueError("grid is too small")
+    elif flag == FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION:
+        raise ValueError("wrong leading dimension")
+    elif flag == FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS:
+        raise ValueError("too few points")
+    elif flag == FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR:
+        raise ValueError("illegal value of FINITEDIFF_NUM_THREADS or FINITEDIFF_WEIGHTS_ENGINE")
+    elif flag == FINITEDIFF_STATUS_ERR_UNKNOWN_LAYOUT:
+        raise ValueError("unknown layout")
+    elif flag == FINITEDIFF_STATUS_ERR_IO:
+        raise IOError("I/O error")
+    elif flag == FINITEDIFF_STATUS_ERR_BAD_FORMAT:
+        raise ValueError("not a (compatible) weights file")
+    elif flag == FINITEDIFF_STATUS_ERR_BAD_PERIOD:
+        raise ValueError("period needs to exceed the extent of grid")
+    elif flag == FINITEDIFF_STATUS_ERR_CALLBACK:
+        raise ValueError("callback failed")
+    elif flag == FINITEDIFF_STATUS_ERR_UNKNOWN_ENGINE:
+        raise ValueError("unknown weights engine")
+    elif flag == FINITEDIFF_STATUS_ERR_BAD_ARGUMENT:
+        raise ValueError("invalid argument")
+    elif flag != FINITEDIFF_STATUS_SUCCESS:
+        raise ValueError("Unknown error (status: %d)" % flag)
+
+
+cdef int _engine_id(engine) except -1:
+    if engine == 'fornberg':
+        return FINITEDIFF_WEIGHTS_FORNBERG
+    elif engine == 'barycentric':
+        return FINITEDIFF_WEIGHTS_BARYCENTRIC
+    raise ValueError("Unknown engine: %s" % engine)
+
+
+cdef int _elem_stride(cnp.ndarray arr, int axis) except -1:
+    if arr.strides[axis] % arr.itemsize:
+        raise ValueError("out: strides not a multiple of itemsize")
+    return arr.strides[axis] // arr.itemsize
+
+
+def _check_out(out, shape, int unit_axis):
+    if out is None:
+        return None
+    if not isinstance(out, np.ndarray) or out.dtype != np.float64:
+        raise TypeError("out needs to be a numpy.ndarray with dtype float64")
+    if out.shape != shape:
+        raise ValueError("out has wrong shape: %s (expected %s)" % (out.shape, shape))
+    if not out.flags.writeable:
+        raise ValueError("out is not writeable")
+    if shape[unit_axis] > 1 and out.strides[unit_axis] != out.itemsize:
+        raise ValueError("out needs unit stride along axis %d" % unit_axis)
+    return out
+
+
+def get_weights(grid, double xtgt, int n=-1, int maxorder=0, engine='fornberg'):
     """
     Generates finite differnece weights.
 
@@ -23,6 +147,8 @@ def get_weights(grid, double xtgt, int n=-1, int maxorder=0):
         Number of points used in ``xarr``. default: -1 (means use length of xarr).
     maxorder: int, optional
         default: 0 (means interpolation)
+    engine: str, optional
+        'fornberg' (default) or 'barycentric' (faster for wide stencils).
 
     Returns
     -------
@@ -32,11 +158,70 @@ def get_weights(grid, double xtgt, int n=-1, int maxorder=0):
          with weights for 0:th order in first column.
     """
     cdef cnp.ndarray[cnp.float64_t, ndim=1] xarr = np.ascontiguousarray(np.ravel(grid), dtype=np.float64)
+    cdef int flag, engine_id = _engine_id(engine)
     if n == -1:
         n = xarr.size
     cdef cnp.ndarray[cnp.float64_t, ndim=2, mode='fortran'] c = \
         np.empty((n, maxorder+1), order='F')
-    finitediff_calculate_weights(&c[0, 0], n, &xarr[0], n, maxorder, xtgt)
+    cdef double * pc = &c[0, 0]
+    cdef const double * px = &xarr[0]
+    with nogil:
+        flag = weights_at_points(pc, 0, n, px, n, maxorder, &xtgt, 1, engine_id)
+    _check_status(flag)
+    return c
+
+
+def get_weights_at_points(grid, xtgts, int n=-1, int maxorder=0, out=None, engine='fornberg'):
+    """
+    Generates finite differnece weights for several target points.
+
+    Parameters
+    ----------
+    grid: array_like
+        Grid points.
+    xtgts: array_like
+        Points at which estimates should be accurate.
+    n: int, optional
+        Number of points used in ``grid``. default: -1 (means use length of grid).
+    maxorder: int, optional
+        default: 0 (means interpolation)
+    out: numpy.ndarray, optional
+        Preallocated output with shape==(len(xtgts), n, maxorder+1), dtype float64
+        and unit stride along the second axis (e.g. an array from previous call).
+    engine: str, optional
+        'fornberg' (default) or 'barycentric' (faster for wide stencils, the
+        barycentric weights of ``grid`` are computed once for all targets).
+
+    Returns
+    -------
+    numpy.ndarray
+         3 dimensional array with shape==(len(xtgts), n, maxorder+1) where
+         ``out[i]`` equals ``get_weights(grid, xtgts[i], n, maxorder)``.
+
+    Notes
+    -----
+    The weights are computed without holding the GIL.
+    """
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] xarr = np.ascontiguousarray(np.ravel(grid), dtype=np.float64)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] tgts = np.ascontiguousarray(np.ravel(xtgts), dtype=np.float64)
+    cdef cnp.ndarray c
+    cdef int flag, ntgts = tgts.size, ld_tgt, ld_deriv, engine_id = _engine_id(engine)
+    if n == -1:
+        n = xarr.size
+    if n > xarr.size:
+        raise ValueError("n larger than size of grid")
+    c = _check_out(out, (ntgts, n, maxorder+1), 1)
+    if c is None:
+        c = np.empty((ntgts, maxorder+1, n)).transpose(0, 2, 1)
+    if c.size == 0:
+        return c
+    ld_tgt, ld_deriv = _elem_stride(c, 0), _elem_stride(c, 2)
+    cdef double * pc = <double *>c.data
+    cdef const double * px = &xarr[0]
+    cdef const double * pt = &tgts[0]
+    with nogil:
+        flag = weights_at_points(pc, ld_tgt, ld_deriv, px, n, maxorder, pt, ntgts, engine_id)
+    _check_status(flag)
     return c
 
 
@@ -95,7 +280,13 @@ def derivatives_at_point_by_finite_diff(
     cdef cnp.ndarray[cnp.float64_t, ndim=1] yout = np.empty((maxorder+1)*nsets)
     if xarr.size < maxorder+1:
         raise ValueError("xdata too short for requested derivative order")
-    finitediff_calc_and_apply_fd(&yout[0], xarr.size, nsets, maxorder, xarr.size, &xarr[0], &yarr[0], xarr.size, xtgt)
+    cdef int flag, len_grid = xarr.size
+    cdef double * po = &yout[0]
+    cdef const double * px = &xarr[0]
+    cdef const double * py = &yarr[0]
+    with nogil:
+        flag = finitediff_calc_and_apply_fd(po, maxorder+1, nsets, maxorder, len_grid, px, py, len_grid, xtgt)
+    _check_status(flag)
     if reshape is None:
         reshape = ydata.ndim != 1
     if reshape:
@@ -103,8 +294,69 @@ def derivatives_at_point_by_finite_diff(
     else:
         return yout
 
+
+def derivatives_at_points_by_finite_diff(
+        grid, ydata, xtgts, int maxorder, yorder='C', out=None):
+    """ Esimates of derivatives up to specified order at several points.
+
+    Vectorised version of :func:`derivatives_at_point_by_finite_diff`,
+    the whole (uncropped) ``grid`` is used for every target.
+
+    Parameters
+    ----------
+    grid : array_like
+        Grid points: values of the independent variable ("x-data").
+    ydata : array_like
+        Values of the dependent variable. May be two dimensional, in
+        which case the weights of the grid is reused.
+    xtgts : array_like
+        The target values of the independent variable where the
+        the finite difference scheme should be applied.
+    maxorder : int
+        Maximum order of derivatives to estimate.
+    yorder : char
+        NumPy "order" of ydata.
+    out : numpy.ndarray, optional
+        Preallocated output with shape==(len(xtgts), nsets, maxorder+1),
+        dtype float64 and unit stride along the last axis.
+
+    Returns
+    -------
+    numpy.ndarray
+        Estimates with shape==(len(xtgts), nsets, maxorder+1).
+
+    Notes
+    -----
+    The estimates are computed without holding the GIL.
+    """
+    ydata = np.asarray(ydata)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] xarr = np.ascontiguousarray(grid, dtype=np.float64)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] yarr = np.ascontiguousarray(np.ravel(ydata, order=yorder), dtype=np.float64)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] tgts = np.ascontiguousarray(np.ravel(xtgts), dtype=np.float64)
+    cdef cnp.ndarray yout
+    cdef int flag, ntgts = tgts.size, len_grid = xarr.size, ld_tgt, ld_set
+    if yarr.size % xarr.size:
+        raise ValueError("Incompatible shapes: grid & ydata")
+    cdef int nsets = yarr.size // xarr.size
+    if xarr.size < maxorder+1:
+        raise ValueError("xdata too short for requested derivative order")
+    yout = _check_out(out, (ntgts, nsets, maxorder+1), 2)
+    if yout is None:
+        yout = np.empty((ntgts, nsets, maxorder+1))
+    if yout.size == 0:
+        return yout
+    ld_tgt, ld_set = _elem_stride(yout, 0), _elem_stride(yout, 1)
+    cdef double * po = <double *>yout.data
+    cdef const double * px = &xarr[0]
+    cdef const double * py = &yarr[0]
+    cdef const double * pt = &tgts[0]
+    with nogil:
+        flag = derivatives_at_points(po, ld_tgt, ld_set, nsets, maxorder, px, len_grid, py, len_grid, pt, ntgts)
+    _check_status(flag)
+    return yout
+
 def interpolate_by_finite_diff(
-        grid, ydata, xtgts, int maxorder=0, int ntail=2, int nhead=2, yorder='C', reshape=None):
+        grid, ydata, xtgts, int maxorder=0, int ntail=2, int nhead=2, yorder='C', reshape=None, period=None):
     """ Estimates derivatives of requested order at multiple points.
 
     Estimates derivatives/function values of requested order
@@ -132,6 +384,9 @@ def interpolate_by_finite_diff(
     reshape: bool
         Whether to return a 3D array or not. Default:
         if ``ydata.ndim != 1``.
+    period : float, optional
+        Length of the period of a periodic function, ``grid`` then holds one
+        period and stencils wrap around its ends (targets may lie anywhere).
 
     Returns
     -------
@@ -170,25 +425,43 @@ def interpolate_by_finite_diff(
         int nout = xtgts.size
         cnp.ndarray[cnp.float64_t, ndim=1] xgrd = np.ascontiguousarray(grid, dtype=np.float64)
         cnp.ndarray[cnp.float64_t, ndim=1] tgts = np.ascontiguousarray(xtgts, dtype=np.float64)
-        cnp.ndarray[cnp.float64_t, ndim=1] yarr = np.ascontiguousarray(np.ravel(ydata, order=yorder), dtype=np.float64)
-        int nsets = yarr.size // xgrd.size
-        cnp.ndarray[cnp.float64_t, ndim=1] yout = np.zeros(
-            (nout*nsets*(maxorder+1)), order='C', dtype=np.float64)
+        cnp.ndarray[cnp.float64_t, ndim=1] yarr
+        int ydata_layout = FINITEDIFF_YDATA_SET_GRID
+        int len_grid = xgrd.size
+        int ldy = len_grid
+
+    if (yorder == 'C' and ydata.ndim == 2 and ydata.shape[1] == len_grid and ydata.dtype == np.float64
+            and ydata.flags.f_contiguous and not ydata.flags.c_contiguous):
+        # grid-major in memory: use it as-is (no copy), the weights are applied across sets with unit stride
+        yarr = np.ravel(ydata, order='F')
+        ydata_layout = FINITEDIFF_YDATA_GRID_SET
+        ldy = ydata.shape[0]
+    else:
+        yarr = np.ascontiguousarray(np.ravel(ydata, order=yorder), dtype=np.float64)
 
     if yarr.size % xgrd.size:
         raise ValueError("Incompatible shapes: grid & ydata")
 
-    flag = finitediff_interpolate_by_finite_diff(
-        <double*>yout.data, nout, nsets, maxorder, nsets*(maxorder+1), maxorder+1,
-        ntail, nhead, <double*>xgrd.data, xgrd.size, <double*>yarr.data, xgrd.size,
-        <double*>tgts.data
-    )
-    if flag == 1:
-        raise ValueError("Bad alloc")
-    elif flag == 2:
-        raise ValueError("grid is too small")
-    if flag == 4:
-        raise ValueError("too few points")
+    cdef int nsets = yarr.size // xgrd.size
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] yout = np.zeros(
+        (nout*nsets*(maxorder+1)), order='C', dtype=np.float64)
+    cdef double per = 0 if period is None else period
+    if period is not None and per <= 0:
+        raise ValueError("period needs to be positive")
+    with nogil:
+        if per > 0:
+            flag = finitediff_interpolate_periodic(
+                <double*>yout.data, nout, nsets, maxorder, FINITEDIFF_OUT_TGT_SET_DERIV, nsets*(maxorder+1), maxorder+1,
+                ntail, nhead, <double*>xgrd.data, len_grid, per, <double*>yarr.data, ydata_layout, ldy,
+                <double*>tgts.data
+            )
+        else:
+            flag = finitediff_interpolate_by_finite_diff_layout(
+                <double*>yout.data, nout, nsets, maxorder, FINITEDIFF_OUT_TGT_SET_DERIV, nsets*(maxorder+1), maxorder+1,
+                ntail, nhead, <double*>xgrd.data, len_grid, <double*>yarr.data, ydata_layout, ldy,
+                <double*>tgts.data
+            )
+    _check_status(flag)
 
     if reshape is None:
         reshape = ydata.ndim != 1
@@ -196,3 +469,508 @@ def interpolate_by_finite_diff(
         return yout.reshape((nout, nsets, maxorder+1))
     else:
         return yout.reshape((nout, -1))
+
+
+def differentiate_on_grid(grid, ydata, int maxorder=1, npoints=None, yorder='C', out=None):
+    """ Derivatives at the grid points themselves.
+
+    Faster than ``interpolate_by_finite_diff(grid, ydata, grid, ...)``: no search is
+    needed and runs of uniform spacing share one stencil (applied as a convolution).
+
+    Parameters
+    ----------
+    grid : array_like
+        Grid points (strictly monotonic).
+    ydata : array_like
+        Values of the dependent variable, shape (len(grid),) or (nsets, len(grid)).
+    maxorder : int
+        Maximum order of derivatives to estimate (default: 1).
+    npoints : int, optional
+        Number of points in each stencil, centred around the node and one-sided at
+        the boundaries (default: smallest odd number greater than ``maxorder``).
+    yorder : char
+        NumPy "order" of ydata.
+    out : numpy.ndarray, optional
+        Preallocated output with shape==(nsets, maxorder+1, len(grid)),
+        dtype float64 and unit stride along the last axis.
+
+    Returns
+    -------
+    numpy.ndarray
+        Estimates with shape==(nsets, maxorder+1, len(grid)).
+
+    Examples
+    --------
+    >>> import numpy as np
+    >>> x = np.linspace(0, 1, 11)
+    >>> np.allclose(differentiate_on_grid(x, x**2)[0, 1], 2*x)
+    True
+
+    """
+    if npoints is None:
+        npoints = maxorder + 1 + maxorder % 2
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] xarr = np.ascontiguousarray(grid, dtype=np.float64)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] yarr = np.ascontiguousarray(
+        np.ravel(np.asarray(ydata), order=yorder), dtype=np.float64)
+    cdef cnp.ndarray yout
+    cdef int flag, len_grid = xarr.size, ld_set, ld_deriv, npts = npoints
+    if len_grid == 0 or yarr.size % len_grid:
+        raise ValueError("Incompatible shapes: grid & ydata")
+    cdef int nsets = yarr.size // len_grid
+    yout = _check_out(out, (nsets, maxorder+1, len_grid), 2)
+    if yout is None:
+        yout = np.empty((nsets, maxorder+1, len_grid))
+    if yout.size == 0:
+        return yout
+    ld_set, ld_deriv = _elem_stride(yout, 0), _elem_stride(yout, 1)
+    cdef double * po = <double *>yout.data
+    cdef const double * px = &xarr[0]
+    cdef const double * py = &yarr[0]
+    with nogil:
+        flag = finitediff_differentiate_on_grid(po, ld_set, ld_deriv, nsets, maxorder, npts,
+                                                px, len_grid, py, len_grid)
+    _check_status(flag)
+    return yout
+
+
+cdef int _batch_callback(double * fx, const double * x, int n, void * user_data) noexcept with gil:
+    # user_data: [callable, exception (set on failure), length of x per point (0: scalar), length of f per point]
+    cdef list state = <list>user_data
+    cdef double[::1] fx_view, src
+    cdef int nx = n*max(<int>state[2], 1), nf = n*<int>state[3]
+    if n == 0:
+        return 0
+    try:
+        xs = np.array(<double[:nx]><double *>x)
+        if state[2]:
+            xs = xs.reshape((n, state[2]))
+        fxs = np.ascontiguousarray(np.ravel(state[0](xs)), dtype=np.float64)
+        if fxs.size != nf:
+            raise ValueError("callback returned %d values for %d points" % (fxs.size, n))
+        src = fxs
+        fx_view = <double[:nf]>fx
+        fx_view[:] = src
+    except BaseException as exc:
+        state[1] = exc
+        return 1
+    return 0
+
+
+def differentiate_function(f, x, int deriv=1, npoints=None, double h0=0.1, double rtol=1e-10,
+                           double atol=0.0, int max_rounds=12, full_output=False):
+    """ Adaptive estimates of a derivative of a (vectorised) function at several points.
+
+    Central finite differences for successively halved steps are extrapolated to zero
+    step (Richardson / Ridders' method) until the error estimate is below
+    ``atol + rtol*abs(estimate)`` or grows due to round-off. Values shared between
+    consecutive steps are reused, all evaluations of a round are made in one call to ``f``.
+
+    Parameters
+    ----------
+    f : callable
+        ``f(xs)`` returns the function values for the 1D array ``xs``.
+    x : array_like
+        Points where the derivative is estimated.
+    deriv : int
+        Order of the derivative (default: 1).
+    npoints : int, optional
+        Number of points in the central stencils (odd, default: smallest odd
+        number greater than ``deriv``).
+    h0 : float
+        Initial step, relative to ``1 + abs(x)`` (default: 0.1).
+    rtol : float
+        Relative tolerance (default: 1e-10).
+    atol : float
+        Absolute tolerance (default: 0).
+    max_rounds : int
+        Maximum number of step sizes (default: 12).
+    full_output : bool
+        Also return error estimates and information about the evaluations.
+
+    Returns
+    -------
+    numpy.ndarray
+        Estimates with the shape of ``x``, when ``full_output`` also: error estimates
+        and a dict with the number of evaluations (``nfev``) and calls (``ncalls``).
+
+    Examples
+    --------
+    >>> import numpy as np
+    >>> d = differentiate_function(np.exp, [0.0, 1.0])
+    >>> np.allclose(d, np.exp([0.0, 1.0]))
+    True
+
+    """
+    if npoints is None:
+        npoints = deriv + 1 + deriv % 2
+    elif npoints % 2 == 0:
+        raise ValueError("npoints needs to be odd (central stencils)")
+    xarr = np.asarray(x, dtype=np.float64)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] xs = np.ascontiguousarray(np.ravel(xarr))
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] yout = np.empty(xs.size)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] yerr = np.empty(xs.size)
+    cdef int flag, n_evals = 0, npts = npoints, len_x = xs.size
+    ncalls = [0]
+    def counted(xb):
+        ncalls[0] += 1
+        return f(xb)
+    cdef list state = [counted, None, 0, 1]
+    cdef double * po = &yout[0] if len_x else NULL
+    cdef double * pe = &yerr[0] if len_x else NULL
+    cdef const double * px = &xs[0] if len_x else NULL
+    cdef void * ud = <void *>state
+    with nogil:
+        flag = finitediff_differentiate_function(po, pe, &n_evals, _batch_callback, ud, px, len_x,
+                                                 deriv, npts, h0, rtol, atol, max_rounds)
+    if state[1] is not None:
+        raise state[1]
+    _check_status(flag)
+    if full_output:
+        return yout.reshape(xarr.shape), yerr.reshape(xarr.shape), dict(nfev=n_evals, ncalls=ncalls[0])
+    return yout.reshape(xarr.shape)
+
+
+def _csr_pattern(sparsity):
+    """ (indptr, indices, shape) of a scipy.sparse matrix or of the non-zeros of an array """
+    if hasattr(sparsity, 'tocsr'):
+        csr = sparsity.tocsr()
+        indptr, indices, shape = csr.indptr, csr.indices, csr.shape
+    else:
+        dense = np.atleast_2d(np.asarray(sparsity)) != 0
+        indptr = np.concatenate(([0], np.cumsum(np.sum(dense, axis=1))))
+        indices = np.nonzero(dense)[1]
+        shape = dense.shape
+    indptr = np.ascontiguousarray(indptr, dtype=np.intc)
+    indices = np.ascontiguousarray(indices, dtype=np.intc)
+    if indptr.size != shape[0] + 1 or indices.size != indptr[-1] or (
+            indices.size and (indices.min() < 0 or indices.max() >= shape[1])):
+        raise ValueError("invalid sparsity pattern")
+    return indptr, indices, shape
+
+
+def color_columns(sparsity):
+    """ Greedy colouring of the columns of a sparsity pattern.
+
+    Columns sharing a row get different colours, i.e. all columns of one colour
+    may be perturbed together when estimating a Jacobian (see :func:`sparse_jacobian`).
+
+    Parameters
+    ----------
+    sparsity : array_like or scipy.sparse matrix
+        Sparsity pattern (non-zero entries) of the Jacobian.
+
+    Returns
+    -------
+    numpy.ndarray
+        Colour (0, 1, ...) of each column.
+    """
+    indptr, indices, shape = _csr_pattern(sparsity)
+    cdef int[::1] ip = indptr, ix = indices
+    cdef cnp.ndarray[int, ndim=1] colors = np.empty(shape[1], dtype=np.intc)
+    cdef int flag, n_colors = 0, nrows = shape[0], ncols = shape[1]
+    cdef int * pc = &colors[0] if ncols else NULL
+    cdef const int * pix = &ix[0] if ix.shape[0] else NULL
+    with nogil:
+        flag = finitediff_color_columns(pc, &n_colors, nrows, ncols, &ip[0], pix)
+    _check_status(flag)
+    return colors
+
+
+def sparse_jacobian(f, x0, sparsity, offsets=(-1, 1), h=None, f0=None, colors=None, int max_batch=0,
+                    full_output=False):
+    """ Finite difference estimate of a Jacobian with known sparsity pattern.
+
+    Columns not sharing a row are perturbed together (see :func:`color_columns`),
+    the number of points where ``f`` is evaluated is proportional to the number of
+    colours rather than to ``len(x0)``.
+
+    Parameters
+    ----------
+    f : callable
+        ``f(X)`` with ``X.shape == (k, len(x0))`` returns the values at the k points,
+        shape ``(k, nrows)``.
+    x0 : array_like
+        Point where the Jacobian is estimated.
+    sparsity : array_like or scipy.sparse matrix
+        Sparsity pattern (non-zero entries), shape ``(nrows, len(x0))``.
+    offsets : sequence of floats
+        Stencil in units of the step (default: central differences).
+    h : float, optional
+        Step relative to ``1 + abs(x0)`` (default: depends on the order of the stencil).
+    f0 : array_like, optional
+        ``f(x0)`` if known (only used for a zero offset).
+    colors : array_like, optional
+        Precomputed colouring (output of :func:`color_columns`).
+    max_batch : int
+        Maximum number of points per call to ``f`` (default: 0, all points in one call).
+    full_output : bool
+        Also return a dict with the number of colours (``ncolors``), of evaluated
+        points (``nfev``) and of calls to ``f`` (``ncalls``).
+
+    Returns
+    -------
+    tuple
+        ``(data, indices, indptr)`` (CSR, e.g. for ``scipy.sparse.csr_matrix``).
+
+    Examples
+    --------
+    >>> import numpy as np
+    >>> data, indices, indptr = sparse_jacobian(lambda X: X**2, [1.0, 2.0], np.eye(2))
+    >>> np.allclose(data, [2, 4])
+    True
+
+    """
+    indptr, indices, shape = _csr_pattern(sparsity)
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] x = np.ascontiguousarray(x0, dtype=np.float64).ravel()
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] offs = np.ascontiguousarray(offsets, dtype=np.float64).ravel()
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] fzero
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] data = np.empty(indices.size)
+    cdef int[::1] ip = indptr, ix = indices, col
+    cdef int flag, n_colors, n_evals = 0, nrows = shape[0], ncols = shape[1], n_offs = offs.size
+    cdef const double * pf0 = NULL
+    cdef double step
+    if x.size != ncols:
+        raise ValueError("Incompatible shapes: x0 & sparsity")
+    if np.unique(offs).size != n_offs:
+        raise ValueError("offsets need to be distinct")
+    col = color_columns(sparsity) if colors is None else np.ascontiguousarray(np.ravel(colors), dtype=np.intc)
+    if col.shape[0] != ncols:
+        raise ValueError("Incompatible shapes: colors & sparsity")
+    n_colors = (np.max(col) + 1) if ncols else 0
+    if colors is not None and ncols:
+        if np.min(col) < 0:
+            raise ValueError("colors need to be non-negative")
+        keys = np.repeat(np.arange(nrows, dtype=np.int64), np.diff(indptr))*n_colors + np.asarray(col)[indices]
+        if np.unique(keys).size != keys.size:
+            raise ValueError("colors: columns sharing a row need different colours")
+    if h is None:
+        # truncation error ~ h**order balanced against round-off ~ eps/h
+        order = n_offs - 1
+        if n_offs % 2 == 0 and np.allclose(np.sort(offs), -np.sort(offs)[::-1]):
+            order += 1  # symmetric stencils (without a zero offset) gain one order
+        h = np.finfo(np.float64).eps**(1.0/(order + 1))
+    step = h
+    if f0 is not None:
+        fzero = np.ascontiguousarray(f0, dtype=np.float64).ravel()
+        if fzero.size != nrows:
+            raise ValueError("Incompatible shapes: f0 & sparsity")
+        pf0 = &fzero[0] if nrows else NULL
+
+    ncalls = [0]
+
+    def counted(X):
+        ncalls[0] += 1
+        return f(X)
+
+    cdef list state = [counted, None, ncols, nrows]
+    cdef void * ud = <void *>state
+    cdef double * pd = &data[0] if data.size else NULL
+    cdef const double * px = &x[0] if ncols else NULL
+    cdef const int * pix = &ix[0] if ix.shape[0] else NULL
+    cdef const int * pcol = &col[0] if ncols else NULL
+    cdef const double * poffs = &offs[0] if n_offs else NULL
+    with nogil:
+        flag = finitediff_sparse_jacobian(pd, &n_evals, _batch_callback, ud, px, nrows, ncols, &ip[0], pix,
+                                          pcol, n_colors, poffs, n_offs, step, pf0, max_batch)
+    if state[1] is not None:
+        raise state[1]
+    _check_status(flag)
+    if full_output:
+        return (data, indices, indptr), dict(ncolors=n_colors, nfev=n_evals, ncalls=ncalls[0])
+    return data, indices, indptr
+
+
+def write_weights_file(path, grid, xtgts, int maxorder=0, int ntail=2, int nhead=2):
+    """ Precomputes weights for ``interpolate_by_finite_diff`` and stores them in a file.
+
+    The file may be opened (memory mapped) by any number of processes using :class:`MappedWeights`.
+
+    Parameters
+    ----------
+    path : str
+        Path of file to (over)write.
+    grid : array_like
+        Values of the independent variable ("x-data").
+    xtgts : array_like
+        Values of the independent variable where the
+        the finite difference scheme should be applied.
+    maxorder : int, optional
+        Up to what order derivatives are to be estimated.
+    ntail : int, optional
+        how many points in ``grid`` before ``xtgts`` to inclued (default = 2).
+    nhead : int, optional
+        how many points in ``grid`` after ``xtgts`` to include (default = 2).
+    """
+    cdef:
+        int flag
+        bytes bpath = os.fsencode(path)
+        cnp.ndarray[cnp.float64_t, ndim=1] xgrd = np.ascontiguousarray(grid, dtype=np.float64)
+        cnp.ndarray[cnp.float64_t, ndim=1] tgts = np.ascontiguousarray(np.ravel(xtgts), dtype=np.float64)
+        const char * cpath = bpath
+        const double * pg = <double*>xgrd.data
+        const double * pt = <double*>tgts.data
+        int len_grid = xgrd.size, len_tgts = tgts.size
+    with nogil:
+        flag = finitediff_weights_write(cpath, pg, len_grid, pt, len_tgts, maxorder, ntail, nhead)
+    _check_status(flag)
+
+
+cdef _apply_view(const finitediff_weights_view * view, ydata, yorder, out):
+    cdef cnp.ndarray[cnp.float64_t, ndim=1] yarr = np.ascontiguousarray(
+        np.ravel(np.asarray(ydata), order=yorder), dtype=np.float64)
+    cdef cnp.ndarray yout
+    cdef int flag, ld_tgt, ld_set, nsets, len_grid = view.len_grid
+    if yarr.size % len_grid:
+        raise ValueError("Incompatible shapes: grid & ydata")
+    nsets = yarr.size // len_grid
+    yout = _check_out(out, (view.len_targets, nsets, view.max_deriv+1), 2)
+    if yout is None:
+        yout = np.empty((view.len_targets, nsets, view.max_deriv+1))
+    if yout.size == 0:
+        return yout
+    ld_tgt, ld_set = _elem_stride(yout, 0), _elem_stride(yout, 1)
+    cdef double * po = <double *>yout.data
+    cdef const double * py = &yarr[0]
+    with nogil:
+        flag = finitediff_apply_weights_view(po, nsets, FINITEDIFF_OUT_TGT_SET_DERIV, ld_tgt, ld_set,
+                                             view, py, FINITEDIFF_YDATA_SET_GRID, len_grid)
+    _check_status(flag)
+    return yout
+
+
+cdef class MappedWeights:
+    """ Read-only memory map of a file written by :func:`write_weights_file`.
+
+    Attributes
+    ----------
+    xtgts : numpy.ndarray
+        Targets, shape (ntgts,).
+    starts : numpy.ndarray
+        Index of first grid point of each stencil, shape (ntgts,).
+    weights : numpy.ndarray
+        Weights, shape (ntgts, maxorder+1, stencil_len).
+    maxorder : int
+    len_grid : int
+
+    All arrays are views of the mapped file (no copies).
+    """
+    cdef finitediff_weights_view view
+    cdef readonly object mmap, xtgts, starts, weights
+    cdef readonly int maxorder, len_grid
+
+    def __init__(self, path):
+        cdef cnp.ndarray mm = np.memmap(path, dtype=np.uint8, mode='r')
+        cdef const char * base = <const char *>mm.data
+        _check_status(finitediff_weights_view_init(&self.view, base, mm.size))
+        self.mmap = mm
+        ntgts, nd, nin = self.view.len_targets, self.view.max_deriv + 1, self.view.stencil_len
+        self.xtgts = np.frombuffer(mm, dtype=np.float64, count=ntgts,
+                                   offset=<const char *>self.view.xtgts - base)
+        self.starts = np.frombuffer(mm, dtype=np.intc, count=ntgts,
+                                    offset=<const char *>self.view.starts - base)
+        self.weights = np.frombuffer(mm, dtype=np.float64, count=ntgts*nd*nin,
+                                     offset=<const char *>self.view.weights - base).reshape((ntgts, nd, nin))
+        self.maxorder = self.view.max_deriv
+        self.len_grid = self.view.len_grid
+
+    def apply(self, ydata, yorder='C', out=None):
+        """ Applies the stored weights to ``ydata`` (sampled on the grid used when writing the file).
+
+        Parameters
+        ----------
+        ydata : array_like
+            Values of the dependent variable, shape (len_grid,) or (nsets, len_grid).
+        yorder : char
+            NumPy "order" of ydata.
+        out : numpy.ndarray, optional
+            Preallocated output with shape==(ntgts, nsets, maxorder+1),
+            dtype float64 and unit stride along the last axis.
+
+        Returns
+        -------
+        numpy.ndarray
+            Estimates with shape==(ntgts, nsets, maxorder+1).
+        """
+        return _apply_view(&self.view, ydata, yorder, out)
+
+
+cdef class MovingGridPlan:
+    """ Weights for ``interpolate_by_finite_diff`` on a grid which moves between calls.
+
+    On :meth:`update` only the stencils whose window shifted, or where a point (or the
+    target) moved more than ``rtol`` times the width of the stencil, are recomputed.
+
+    Parameters
+    ----------
+    grid : array_like
+        Values of the independent variable ("x-data").
+    xtgts : array_like
+        Values of the independent variable where the
+        the finite difference scheme should be applied.
+    maxorder : int, optional
+        Up to what order derivatives are to be estimated.
+    ntail : int, optional
+        how many points in ``grid`` before ``xtgts`` to inclued (default = 2).
+    nhead : int, optional
+        how many points in ``grid`` after ``xtgts`` to include (default = 2).
+    rtol : float, optional
+        Relative tolerance for movement (default: 0, i.e. any change).
+
+    Notes
+    -----
+    :meth:`update` and :meth:`apply` release the GIL. A plan may be shared between threads,
+    calls to these methods are serialized by a lock held by the plan (an update rewrites the
+    weights in place).
+
+    Examples
+    --------
+    >>> plan = MovingGridPlan(x, xout, maxorder=1, rtol=1e-6)
+    >>> nrefreshed = plan.update(x_next_step)
+    >>> r = plan.apply(y_next_step)
+    """
+    cdef finitediff_plan * plan
+    cdef object lock
+    cdef readonly int len_grid, len_targets, maxorder
+
+    def __cinit__(self, grid, xtgts, int maxorder=0, int ntail=2, int nhead=2, double rtol=0.0):
+        cdef:
+            int flag
+            cnp.ndarray[cnp.float64_t, ndim=1] xgrd = np.ascontiguousarray(grid, dtype=np.float64)
+            cnp.ndarray[cnp.float64_t, ndim=1] tgts = np.ascontiguousarray(np.ravel(xtgts), dtype=np.float64)
+        self.plan = NULL
+        self.lock = threading.Lock()
+        flag = finitediff_plan_create(&self.plan, <double*>xgrd.data, xgrd.size, <double*>tgts.data, tgts.size,
+                                      maxorder, ntail, nhead, rtol)
+        _check_status(flag)
+        self.len_grid, self.len_targets, self.maxorder = xgrd.size, tgts.size, maxorder
+
+    def __dealloc__(self):
+        finitediff_plan_destroy(self.plan)
+
+    def update(self, grid, xtgts=None):
+        """ Updates the grid (and optionally the targets), returns the number of recomputed stencils. """
+        cdef:
+            int flag, n_refreshed
+            cnp.ndarray[cnp.float64_t, ndim=1] xgrd = np.ascontiguousarray(grid, dtype=np.float64)
+            cnp.ndarray[cnp.float64_t, ndim=1] tgts
+            const double * pt = NULL
+        if xgrd.size != self.len_grid:
+            raise ValueError("Size of grid may not change")
+        if xtgts is not None:
+            tgts = np.ascontiguousarray(np.ravel(xtgts), dtype=np.float64)
+            if tgts.size != self.len_targets:
+                raise ValueError("Number of targets may not change")
+            pt = <double*>tgts.data
+        cdef const double * px = <double*>xgrd.data
+        with self.lock:
+            with nogil:
+                flag = finitediff_plan_update(self.plan, px, pt, &n_refreshed)
+        _check_status(flag)
+        return n_refreshed
+
+    def apply(self, ydata, yorder='C', out=None):
+        """ Estimates at the targets from ``ydata`` (on the current grid), shape (ntgts, nsets, maxorder+1). """
+        cdef finitediff_weights_view view
+        with self.lock:
+            finitediff_plan_view(self.plan, &view)
+            return _apply_view(&view, ydata, yorder, out)
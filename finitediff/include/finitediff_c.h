@@ -1,4 +1,5 @@
 #pragma once
+#include <stddef.h> /* size_t */
 #ifndef FINITEDIFF_REAL
   #define FINITEDIFF_REAL double
 #endif
@@ -14,7 +15,7 @@
 #define FINITEDIFF_MIN(x, y) (((x) < (y)) ? (x) : (y))
 #define FINITEDIFF_MAX(x, y) (((x) > (y)) ? (x) : (y))
 /* We're assuming the L1 cache of the CPU is 64 bytes long (used to avoid false sharing): */
-#define FINITEDIFF_ROUND_L1(x) ((((unsigned)(sizeof(FINITEDIFF_REAL)*x) + 63u) & ~63u)/sizeof(FINITEDIFF_REAL))
+#define FINITEDIFF_ROUND_L1(x) ((((unsigned)(sizeof(FINITEDIFF_REAL)*(x)) + 63u) & ~63u)/sizeof(FINITEDIFF_REAL))
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,7 +27,49 @@ enum FINITEDIFF_STATUS_CODES {
     FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID=2,
     FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION=3,
     FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS=4,
-    FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR=5
+    FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR=5,
+    FINITEDIFF_STATUS_ERR_UNKNOWN_LAYOUT=6,
+    FINITEDIFF_STATUS_ERR_IO=7,
+    FINITEDIFF_STATUS_ERR_BAD_FORMAT=8,
+    FINITEDIFF_STATUS_ERR_BAD_PERIOD=9,
+    FINITEDIFF_STATUS_ERR_CALLBACK=10,
+    FINITEDIFF_STATUS_ERR_UNKNOWN_ENGINE=11,
+    FINITEDIFF_STATUS_ERR_BAD_ARGUMENT=12
+};
+
+/* Memory layout of ``ydata`` (the leading dimension ``ldy`` is the stride of the outer axis) */
+enum FINITEDIFF_YDATA_LAYOUT {
+    FINITEDIFF_YDATA_SET_GRID=0, /* ydata[set_idx*ldy + grid_idx] */
+    FINITEDIFF_YDATA_GRID_SET=1  /* ydata[grid_idx*ldy + set_idx] (sets contiguous) */
+};
+
+/* Memory layout of ``out`` (strides of the two outer axes are given explicitly, innermost has unit stride) */
+enum FINITEDIFF_OUT_LAYOUT {
+    FINITEDIFF_OUT_TGT_SET_DERIV=0, /* out[tgt_idx*strides_0 + set_idx*strides_1 + deriv_idx] */
+    FINITEDIFF_OUT_DERIV_SET_TGT=1  /* out[deriv_idx*strides_0 + set_idx*strides_1 + tgt_idx] */
+};
+
+/* Algorithms for generating weights */
+enum FINITEDIFF_WEIGHTS_ENGINE {
+    FINITEDIFF_WEIGHTS_FORNBERG=0,   /* finitediff_calculate_weights */
+    FINITEDIFF_WEIGHTS_BARYCENTRIC=1 /* finitediff_calculate_weights_barycentric */
+};
+
+/* Stencil size from which ``FINITEDIFF_WEIGHTS_ENGINE=auto`` selects the barycentric engine
+   (see tests/bench_weights.c, "bary+s" versus "fornberg", for the crossover) */
+#ifndef FINITEDIFF_BARYCENTRIC_MIN_STENCIL
+  #define FINITEDIFF_BARYCENTRIC_MIN_STENCIL 12
+#endif
+
+/* Relative tolerance (w.r.t. the spacing) below which ``finitediff_differentiate_on_grid`` treats spacings as equal */
+#ifndef FINITEDIFF_UNIFORM_RTOL
+  #define FINITEDIFF_UNIFORM_RTOL 1e-12
+#endif
+
+/* Kernel variants for applying weights to ``FINITEDIFF_YDATA_SET_GRID`` data (chosen by the autotuner) */
+enum FINITEDIFF_APPLY_VARIANT {
+    FINITEDIFF_APPLY_NAIVE=0,  /* one dot product per set and derivative */
+    FINITEDIFF_APPLY_BLOCKED=1 /* blocks of four sets share each load of the weights */
 };
 
 /*
@@ -64,6 +107,88 @@ void finitediff_calculate_weights(
     const FINITEDIFF_REAL around
 );
 
+/*
+  finitediff_barycentric_weights
+  ==============================
+
+  Parameters
+  ----------
+  b[len_grid]: (scaled) barycentric weights of ``grid`` (output argument)
+  grid[len_grid]: array with grid point locations (unique)
+  len_grid: length of grid
+
+  Returns
+  -------
+  The scaling length (capacity) used, to be passed to ``finitediff_calculate_weights_barycentric``.
+
+  Notes
+  -----
+  Costs O(len_grid**2), only needs to be done once per grid.
+*/
+FINITEDIFF_REAL finitediff_barycentric_weights(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT b,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid
+);
+
+/*
+  finitediff_barycentric_weights_shift
+  ====================================
+
+  Updates the barycentric weights of a stencil which moved one point along the grid, in
+  O(len_grid) instead of the O(len_grid**2) of ``finitediff_barycentric_weights``.
+
+  Parameters
+  ----------
+  b[len_grid]: barycentric weights of the previous stencil (input), of ``grid`` (output)
+  grid[len_grid]: the new stencil
+  len_grid: length of the stencil
+  dropped: point of the previous stencil which is not in ``grid``
+  direction: 1: ``dropped`` preceded grid[0] (grid[len_grid-1] is new),
+            -1: ``dropped`` followed grid[len_grid-1] (grid[0] is new)
+  cap: capacity used for ``b`` (the value returned by ``finitediff_barycentric_weights``)
+
+  Notes
+  -----
+  Rounding errors accumulate (a few ulp per shift) and the capacity is not adapted to the
+  width of the new stencil: recompute with ``finitediff_barycentric_weights`` now and then
+  (e.g. every len_grid shifts, which keeps the amortized cost at O(len_grid) per shift).
+*/
+void finitediff_barycentric_weights_shift(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT b,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL dropped,
+    const int direction,
+    const FINITEDIFF_REAL cap
+);
+
+/*
+  finitediff_calculate_weights_barycentric
+  ========================================
+
+  Same output as ``finitediff_calculate_weights`` but computed by differentiating the
+  Lagrange basis polynomials in barycentric form, at a cost of O(len_grid*(max_deriv+1)**2)
+  per target (as opposed to O(len_grid**2*(max_deriv+1))). Preferable for wide stencils.
+
+  Parameters
+  ----------
+  (as for ``finitediff_calculate_weights``)
+  b, cap: output of ``finitediff_barycentric_weights`` for ``grid``
+  work[max_deriv+1]: scratch space
+*/
+void finitediff_calculate_weights_barycentric(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT weights,
+    const int ld_weights,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const int max_deriv,
+    const FINITEDIFF_REAL around,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT b,
+    const FINITEDIFF_REAL cap,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT work
+);
+
 /*
   finitediff_apply_fd
   ===================
@@ -93,6 +218,47 @@ void finitediff_apply_fd(
     const int ldy
 );
 
+/*
+  finitediff_apply_fd_direct
+  ==========================
+
+  Derivatives at ``xtgt`` computed directly from ``ydata``, i.e. without forming the
+  weights: the Taylor coefficients of the interpolating polynomial (barycentric Lagrange
+  form) are accumulated with running products. O(len_grid**2) operations (``len_grid``
+  divisions) plus O(len_grid*max_deriv) per set, cheaper than ``finitediff_calculate_weights``
+  followed by ``finitediff_apply_fd`` for few sets.
+
+  Parameters
+  ----------
+  (as for ``finitediff_calc_and_apply_fd``)
+  work : scratch of length ``FINITEDIFF_DIRECT_WORK_LEN(len_grid, max_deriv)``
+
+*/
+#define FINITEDIFF_DIRECT_WORK_LEN(len_grid, max_deriv) ((len_grid) + 2*((max_deriv) + 1))
+
+void finitediff_apply_fd_direct(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int ld_out,
+    const int nsets,
+    const int max_deriv,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ldy,
+    const FINITEDIFF_REAL xtgt,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT work
+);
+
+/* ``finitediff_calc_and_apply_fd`` uses ``finitediff_apply_fd_direct`` (with scratch on the stack) when
+   ``len_grid >= nsets*FINITEDIFF_DIRECT_MIN_POINTS_PER_SET`` and the scratch fits in FINITEDIFF_DIRECT_MAX_WORK
+   elements (the weights are cheaper to form for short stencils and to reuse for many sets) */
+#ifndef FINITEDIFF_DIRECT_MIN_POINTS_PER_SET
+  #define FINITEDIFF_DIRECT_MIN_POINTS_PER_SET 8
+#endif
+#ifndef FINITEDIFF_DIRECT_MAX_WORK
+  #define FINITEDIFF_DIRECT_MAX_WORK 256
+#endif
+
 /*
   finitediff_calc_apply_fd
   ========================
@@ -145,6 +311,411 @@ int finitediff_interpolate_by_finite_diff(
     const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts /* len(xtgts) == len_targets */
 );
 
+/*
+  finitediff_interpolate_by_finite_diff_layout
+  ============================================
+
+  Same as ``finitediff_interpolate_by_finite_diff`` but with selectable memory
+  layouts of ``out`` and ``ydata``. With ``FINITEDIFF_YDATA_GRID_SET`` the weights
+  are applied with unit stride across the data sets.
+
+  Parameters
+  ----------
+  out_layout : one of ``FINITEDIFF_OUT_LAYOUT``
+  elem_strides_out_0 : stride of the outermost axis of ``out``
+  elem_strides_out_1 : stride of the middle (set) axis of ``out``
+  ydata_layout : one of ``FINITEDIFF_YDATA_LAYOUT``
+  ldy : stride of the outer axis of ``ydata``
+
+  Returns
+  -------
+  see ``FINITEDIFF_STATUS_CODES``
+*/
+int finitediff_interpolate_by_finite_diff_layout(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int len_targets,
+    const int nsets,
+    const int max_deriv,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts
+);
+
+/*
+  finitediff_interpolate_periodic
+  ===============================
+
+  Same as ``finitediff_interpolate_by_finite_diff_layout`` for a periodic function:
+  ``grid`` (increasing) holds one period, ``y(x + period) == y(x)``. Targets may lie
+  anywhere, stencils crossing the ends of ``grid`` wrap around (indices modulo ``len_grid``,
+  points shifted by ``period``), i.e. no padded copies of ``grid`` and ``ydata`` are needed.
+
+  Parameters
+  ----------
+  period : length of the period (``> grid[len_grid-1] - grid[0]``)
+  (others as for ``finitediff_interpolate_by_finite_diff_layout``)
+
+  Returns
+  -------
+  see ``FINITEDIFF_STATUS_CODES``, ``FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID`` if
+  ``len_grid < nhead + ntail``
+*/
+int finitediff_interpolate_periodic(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int len_targets,
+    const int nsets,
+    const int max_deriv,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL period,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts
+);
+
+/*
+  Autotuning
+  ==========
+
+  ``finitediff_interpolate_by_finite_diff_layout`` looks up the number of threads,
+  the apply kernel and the weights engine in a process wide table keyed on (bucketed) problem shape:
+  ``min(len_grid, nhead+ntail)``, ``log2(nsets)``, ``log2(len_targets)``, ``max_deriv``
+  and the layouts. Shapes not in the table use one thread, the naive kernel and the
+  Fornberg engine.
+
+  finitediff_autotune_interpolate: same arguments and output as
+      ``finitediff_interpolate_by_finite_diff_layout``, times the candidate strategies
+      and stores the fastest in the table (saved to ``FINITEDIFF_TUNING_FILE`` if set).
+  finitediff_tuning_load: reads a tuning file (entries are merged into the table).
+  finitediff_tuning_save: writes the table to a tuning file.
+  finitediff_tuning_clear: empties the table.
+
+  Environment variables
+  ---------------------
+  FINITEDIFF_TUNING_FILE: read on first call, written after each autotuning.
+  FINITEDIFF_AUTOTUNE: if non-zero, shapes missing from the table are tuned on first use.
+  FINITEDIFF_NUM_THREADS: takes precedence over the tuned number of threads (and disables autotuning).
+  FINITEDIFF_WEIGHTS_ENGINE: "fornberg", "barycentric" or "auto" (barycentric for stencils of at
+      least ``FINITEDIFF_BARYCENTRIC_MIN_STENCIL`` points), takes precedence over the tuned
+      engine (and disables autotuning), other values give ``FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR``.
+      Also used by ``finitediff_interpolate_periodic`` and the plans for moving grids.
+
+  The table is guarded by a lock, all functions may be called from several threads (when
+  the same shape is tuned concurrently the last result is kept). Lines of a tuning file with
+  unknown kernel variants or engines are ignored.
+*/
+int finitediff_autotune_interpolate(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int len_targets,
+    const int nsets,
+    const int max_deriv,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts
+);
+
+int finitediff_tuning_load(const char * const path);
+
+int finitediff_tuning_save(const char * const path);
+
+void finitediff_tuning_clear(void);
+
+/*
+  Weights files
+  =============
+
+  Precomputed stencils (first grid index) and weights for a set of targets, in a
+  versioned binary format which may be ``mmap``:ed and used in place (no parsing or copying):
+
+      [0, 64)        header: char magic[8] = "FDWEIGHT", then 14 ``int``:
+                     endian tag (0x01020304 in writer's byte order), format version,
+                     sizeof(FINITEDIFF_REAL), len_targets, max_deriv, stencil_len, len_grid
+                     and 7 reserved (zero)
+      [off_xtgts)    FINITEDIFF_REAL xtgts[len_targets]
+      [off_starts)   int starts[len_targets]
+      [off_weights)  FINITEDIFF_REAL weights[len_targets][max_deriv+1][stencil_len]
+
+  where each section starts at a multiple of 64 bytes. Files with foreign byte order,
+  other ``FINITEDIFF_REAL`` or unknown versions are rejected (``FINITEDIFF_STATUS_ERR_BAD_FORMAT``).
+
+  finitediff_weights_nbytes: size of the file.
+  finitediff_weights_build: calculates weights (same stencils as ``finitediff_interpolate_by_finite_diff``)
+      into the caller provided ``buf`` (aligned to 64 bytes, e.g. shared memory).
+  finitediff_weights_write: as ``finitediff_weights_build`` but writes to the file at ``path``.
+  finitediff_weights_view_init: validates ``data`` (including that each stencil lies within the grid)
+      and points ``view`` into it.
+  finitediff_weights_mmap / finitediff_weights_munmap: read-only mapping (POSIX only,
+      ``FINITEDIFF_STATUS_ERR_IO`` elsewhere).
+  finitediff_apply_weights_view: estimates at all targets of ``view`` (``out`` and ``ydata``
+      as in ``finitediff_interpolate_by_finite_diff_layout``).
+*/
+#define FINITEDIFF_WEIGHTS_FORMAT_VERSION 1
+
+typedef struct {
+    const FINITEDIFF_REAL * xtgts;
+    const int * starts;
+    const FINITEDIFF_REAL * weights;
+    int len_targets;
+    int max_deriv;
+    int stencil_len;
+    int len_grid;
+} finitediff_weights_view;
+
+size_t finitediff_weights_nbytes(const int len_targets, const int max_deriv, const int stencil_len);
+
+int finitediff_weights_build(
+    void * const buf,
+    const size_t nbytes,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    const int len_targets,
+    const int max_deriv,
+    const int ntail,
+    const int nhead
+);
+
+int finitediff_weights_write(
+    const char * const path,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    const int len_targets,
+    const int max_deriv,
+    const int ntail,
+    const int nhead
+);
+
+int finitediff_weights_view_init(
+    finitediff_weights_view * const view,
+    const void * const data,
+    const size_t nbytes
+);
+
+int finitediff_weights_mmap(
+    finitediff_weights_view * const view,
+    const void ** const data,
+    size_t * const nbytes,
+    const char * const path
+);
+
+int finitediff_weights_munmap(const void * const data, const size_t nbytes);
+
+int finitediff_apply_weights_view(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int nsets,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const finitediff_weights_view * const view,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy
+);
+
+/*
+  finitediff_differentiate_on_grid
+  ================================
+
+  Derivatives at the grid points themselves (``targets == grid``). Each node uses the
+  ``npoints`` points centred around it (``(npoints-1)/2`` before), one-sided stencils at
+  the boundaries. Runs of uniformly spaced points share a single stencil which is applied
+  as a convolution (vectorised along the nodes), other nodes get their own weights.
+
+  Parameters
+  ----------
+  out : out[set_idx*ld_out_set + deriv_idx*ld_out_deriv + grid_idx]
+  ld_out_set : stride of the set axis of ``out``
+  ld_out_deriv : stride of the derivative axis of ``out``
+  nsets : number of data sets
+  max_deriv : highest derivative
+  npoints : number of points in each stencil (clipped to ``len_grid``)
+  grid : grid points (strictly monotonic)
+  len_grid : length of ``grid``
+  ydata : ydata[set_idx*ldy + grid_idx]
+  ldy : leading dimension of ``ydata``
+
+  Returns
+  -------
+  see ``FINITEDIFF_STATUS_CODES``
+*/
+int finitediff_differentiate_on_grid(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int ld_out_set,
+    const int ld_out_deriv,
+    const int nsets,
+    const int max_deriv,
+    const int npoints,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ldy
+);
+
+/*
+  finitediff_differentiate_function
+  =================================
+
+  Derivative of order ``deriv`` of a function, given as a callback, at ``len_x`` points.
+  Central stencils of an odd number of points ``npoints`` (``FINITEDIFF_STATUS_ERR_BAD_ARGUMENT``
+  if even) with offsets ``k*h`` (``k = -npoints/2 .. npoints/2``, Fornberg weights)
+  are evaluated for steps ``h = h0*(1 + |x|)/2**i`` and extrapolated to ``h = 0`` in a
+  Richardson table (Ridders' method). A point is done when the error estimate meets
+  ``atol + rtol*|estimate|``, when it grows again (round-off) or after ``max_rounds`` steps;
+  the estimate with the smallest error estimate is returned.
+
+  Halving the step reuses the values at even ``k``, so each round after the first needs
+  only the odd offsets. All evaluations of a round (for all unfinished points) are passed
+  to ``cb`` as one batch.
+
+  Parameters
+  ----------
+  out : estimates (``len_x``)
+  err : error estimates (``len_x``, may be NULL)
+  n_evals : total number of function evaluations (may be NULL)
+  cb : ``cb(fx, x, n, user_data)`` evaluates ``fx[i] = f(x[i])`` for ``i < n``,
+       returning non-zero aborts (``FINITEDIFF_STATUS_ERR_CALLBACK``)
+  max_rounds : number of step sizes at most (>= 2)
+
+  Returns
+  -------
+  see ``FINITEDIFF_STATUS_CODES``
+*/
+typedef int (*finitediff_batch_callback)(
+    FINITEDIFF_REAL * const fx, const FINITEDIFF_REAL * const x, const int n, void * const user_data);
+
+int finitediff_differentiate_function(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT err,
+    int * const n_evals,
+    finitediff_batch_callback cb,
+    void * const user_data,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT x,
+    const int len_x,
+    const int deriv,
+    const int npoints,
+    const FINITEDIFF_REAL h0,
+    const FINITEDIFF_REAL rtol,
+    const FINITEDIFF_REAL atol,
+    const int max_rounds
+);
+
+/*
+  Sparse Jacobians
+  ================
+
+  Finite difference estimates of the Jacobian of ``f: R**ncols -> R**nrows`` with a known
+  sparsity pattern (CSR: ``indptr[nrows+1]``, column ``indices``). Columns which do not share
+  a row get the same colour and are perturbed together, so the number of evaluations is
+  proportional to the number of colours rather than to ``ncols``.
+
+  finitediff_color_columns: greedy distance-2 colouring (largest columns first),
+      ``colors[ncols]`` in ``0 .. *n_colors - 1``.
+  finitediff_sparse_jacobian: ``data[indptr[nrows]]`` (the values of the CSR pattern) from the
+      stencil ``offsets[n_offsets]`` (in units of the step ``h*(1 + |x0[j]|)``, Fornberg weights
+      of the first derivative, e.g. {-1, 1}: central, {0, 1}: forward differences). ``f0``
+      (``f(x0)``, may be NULL) is used for a zero offset. ``cb(fx, x, n, user_data)`` evaluates
+      ``fx[k*nrows + i] = f_i(x[k*ncols + :])`` for ``k < n``, with at most ``max_batch``
+      points per call (``<= 0``: all points in one call), returning non-zero aborts
+      (``FINITEDIFF_STATUS_ERR_CALLBACK``). ``*n_evals`` (may be NULL): number of points evaluated.
+      Repeated offsets, colours outside ``0 .. n_colors - 1`` and columns of one colour sharing
+      a row give ``FINITEDIFF_STATUS_ERR_BAD_ARGUMENT`` (before any evaluation).
+*/
+typedef int (*finitediff_jacobian_callback)(
+    FINITEDIFF_REAL * const fx, const FINITEDIFF_REAL * const x, const int n, void * const user_data);
+
+int finitediff_color_columns(
+    int * const FINITEDIFF_RESTRICT colors,
+    int * const n_colors,
+    const int nrows,
+    const int ncols,
+    const int * const FINITEDIFF_RESTRICT indptr,
+    const int * const FINITEDIFF_RESTRICT indices
+);
+
+int finitediff_sparse_jacobian(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT data,
+    int * const n_evals,
+    finitediff_jacobian_callback cb,
+    void * const user_data,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT x0,
+    const int nrows,
+    const int ncols,
+    const int * const FINITEDIFF_RESTRICT indptr,
+    const int * const FINITEDIFF_RESTRICT indices,
+    const int * const FINITEDIFF_RESTRICT colors,
+    const int n_colors,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT offsets,
+    const int n_offsets,
+    const FINITEDIFF_REAL h,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT f0,
+    const int max_batch
+);
+
+/*
+  Plans for moving grids
+  ======================
+
+  A plan holds the stencils and weights (for all targets) of a grid which changes slightly
+  between calls. On update only stencils whose window shifted, or where a member point (or
+  the target) moved more than ``rtol`` times the width of the stencil since its weights were
+  computed, get new weights (``rtol == 0``: any change). The weights are applied with
+  ``finitediff_apply_weights_view`` (see ``finitediff_plan_view``), they are valid until the next update.
+  A plan has no lock of its own: an update rewrites grid, targets and weights in place, so it must
+  not run concurrently with any other use of the same plan (or of a view of it).
+
+  finitediff_plan_create: computes all weights, ``*plan`` is to be released with ``finitediff_plan_destroy``.
+  finitediff_plan_update: ``xtgts`` may be NULL (unchanged targets), ``*n_refreshed`` is set to the
+      number of recomputed stencils (computed in parallel when compiled with OpenMP).
+  finitediff_plan_view: points ``view`` to the current weights of ``plan``.
+*/
+typedef struct finitediff_plan finitediff_plan;
+
+int finitediff_plan_create(
+    finitediff_plan ** const plan,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    const int len_targets,
+    const int max_deriv,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL rtol
+);
+
+int finitediff_plan_update(
+    finitediff_plan * const plan,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    int * const n_refreshed
+);
+
+void finitediff_plan_view(const finitediff_plan * const plan, finitediff_weights_view * const view);
+
+void finitediff_plan_destroy(finitediff_plan * const plan);
+
 #ifdef __cplusplus
 }
 #endif
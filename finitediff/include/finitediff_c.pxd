@@ -1,6 +1,58 @@
 # -*- coding: utf-8; mode: cython -*-
 
-cdef extern from "finitediff_c.h":
-     cdef int finitediff_calculate_weights(double *, int, double *, int, int, double)
-     cdef int finitediff_calc_and_apply_fd(double *, int, int, int, int, double *, double *, int, double)
-     cdef int finitediff_interpolate_by_finite_diff(double * out, int, int, int, int, int, int, int, double *, int, double *, int, double *)
+cdef extern from "finitediff_c.h" nogil:
+     cdef enum FINITEDIFF_STATUS_CODES:
+         FINITEDIFF_STATUS_SUCCESS
+         FINITEDIFF_STATUS_ERR_BAD_ALLOC
+         FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID
+         FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION
+         FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS
+         FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR
+         FINITEDIFF_STATUS_ERR_UNKNOWN_LAYOUT
+         FINITEDIFF_STATUS_ERR_IO
+         FINITEDIFF_STATUS_ERR_BAD_FORMAT
+         FINITEDIFF_STATUS_ERR_BAD_PERIOD
+         FINITEDIFF_STATUS_ERR_CALLBACK
+         FINITEDIFF_STATUS_ERR_UNKNOWN_ENGINE
+         FINITEDIFF_STATUS_ERR_BAD_ARGUMENT
+     cdef enum FINITEDIFF_YDATA_LAYOUT:
+         FINITEDIFF_YDATA_SET_GRID
+         FINITEDIFF_YDATA_GRID_SET
+     cdef enum FINITEDIFF_WEIGHTS_ENGINE:
+         FINITEDIFF_WEIGHTS_FORNBERG
+         FINITEDIFF_WEIGHTS_BARYCENTRIC
+     cdef enum FINITEDIFF_OUT_LAYOUT:
+         FINITEDIFF_OUT_TGT_SET_DERIV
+         FINITEDIFF_OUT_DERIV_SET_TGT
+     cdef void finitediff_calculate_weights(double *, int, const double *, int, int, double)
+     cdef double finitediff_barycentric_weights(double *, const double *, int)
+     cdef void finitediff_barycentric_weights_shift(double *, const double *, int, double, int, double)
+     cdef void finitediff_calculate_weights_barycentric(double *, int, const double *, int, int, double, const double *, double, double *)
+     cdef void finitediff_apply_fd(double *, int, double *, int, int, int, int, const double *, int)
+     cdef int finitediff_calc_and_apply_fd(double *, int, int, int, int, const double *, const double *, int, double)
+     cdef int finitediff_interpolate_by_finite_diff(double * out, int, int, int, int, int, int, int, const double *, int, const double *, int, const double *)
+     cdef int finitediff_differentiate_on_grid(double *, int, int, int, int, int, const double *, int, const double *, int)
+     cdef int finitediff_interpolate_periodic(double * out, int, int, int, int, int, int, int, int, const double *, int, double, const double *, int, int, const double *)
+     cdef int finitediff_interpolate_by_finite_diff_layout(double * out, int, int, int, int, int, int, int, int, const double *, int, const double *, int, int, const double *)
+     ctypedef struct finitediff_weights_view:
+         const double * xtgts
+         const int * starts
+         const double * weights
+         int len_targets
+         int max_deriv
+         int stencil_len
+         int len_grid
+     cdef int finitediff_weights_write(const char *, const double *, int, const double *, int, int, int, int)
+     cdef int finitediff_weights_view_init(finitediff_weights_view *, const void *, size_t)
+     cdef int finitediff_apply_weights_view(double *, int, int, int, int, const finitediff_weights_view *, const double *, int, int)
+     ctypedef struct finitediff_plan:
+         pass
+     cdef int finitediff_plan_create(finitediff_plan **, const double *, int, const double *, int, int, int, int, double)
+     cdef int finitediff_plan_update(finitediff_plan *, const double *, const double *, int *)
+     cdef void finitediff_plan_view(const finitediff_plan *, finitediff_weights_view *)
+     cdef void finitediff_plan_destroy(finitediff_plan *)
+     ctypedef int (*finitediff_batch_callback)(double *, const double *, int, void *)
+     cdef int finitediff_differentiate_function(double *, double *, int *, finitediff_batch_callback, void *, const double *, int, int, int, double, double, double, int)
+     ctypedef int (*finitediff_jacobian_callback)(double *, const double *, int, void *)
+     cdef int finitediff_color_columns(int *, int *, int, int, const int *, const int *)
+     cdef int finitediff_sparse_jacobian(double *, int *, finitediff_jacobian_callback, void *, const double *, int, int, const int *, const int *, const int *, int, const double *, int, double, const double *, int)
@@ -1,5 +1,6 @@
 #pragma once
 #include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <vector>
 
@@ -7,6 +8,20 @@ namespace finitediff {
     // Recommended functions:
     // calculate_weights (or generate_weights as a convenient wrapper)
 
+    // apply_fd evaluates without forming the weights for stencils of at least direct_min_points
+    // points whose scratch fits in direct_max_work elements (on the stack), same macros and
+    // defaults as FINITEDIFF_DIRECT_MIN_POINTS_PER_SET & FINITEDIFF_DIRECT_MAX_WORK in finitediff_c.h
+#ifdef FINITEDIFF_DIRECT_MIN_POINTS_PER_SET
+    constexpr int direct_min_points = FINITEDIFF_DIRECT_MIN_POINTS_PER_SET;
+#else
+    constexpr int direct_min_points = 8;
+#endif
+#ifdef FINITEDIFF_DIRECT_MAX_WORK
+    constexpr int direct_max_work = FINITEDIFF_DIRECT_MAX_WORK;
+#else
+    constexpr int direct_max_work = 256;
+#endif
+
     template <typename Real_t>
     void calculate_weights(const Real_t * const __restrict__ grid, const unsigned len_g,
                            const unsigned max_deriv, Real_t * const __restrict__ weights, const Real_t around=0) {
@@ -62,6 +77,90 @@ namespace finitediff {
         }
     }
 
+    template <typename Real_t>
+    Real_t barycentric_weights(const Real_t * const __restrict__ grid, const unsigned len_g,
+                               Real_t * const __restrict__ b) {
+        // Parameters
+        // ----------
+        // grid[len_g]: array with grid point locations (unique)
+        // len_g: length of grid
+        // b[len_g]: (scaled) barycentric weights (output argument)
+        //
+        // Returns the scaling length (capacity, length of grid / 4) used.
+        Real_t lo = grid[0], hi = grid[0];
+        for (unsigned i=1; i < len_g; ++i){
+            lo = std::min(lo, grid[i]);
+            hi = std::max(hi, grid[i]);
+        }
+        const Real_t cap = (hi > lo) ? (hi - lo)/4 : 1;
+        const Real_t cap_r = 1/cap;
+        for (unsigned j=0; j < len_g; ++j){
+            Real_t prod = 1;
+            for (unsigned i=0; i < len_g; ++i){
+                if (i != j)
+                    prod *= (grid[j] - grid[i])*cap_r;
+            }
+            b[j] = 1/prod;
+        }
+        return cap;
+    }
+
+    template <typename Real_t>
+    void calculate_weights_barycentric(const Real_t * const __restrict__ grid, const unsigned len_g,
+                                       const unsigned max_deriv, Real_t * const __restrict__ weights,
+                                       const Real_t around=0, const Real_t * bary=0, Real_t cap=0) {
+        // Same output as calculate_weights but O(len_g*(max_deriv+1)**2) instead of
+        // O(len_g**2*(max_deriv+1)), preferable for wide stencils.
+        //
+        // Parameters
+        // ----------
+        // (as for calculate_weights)
+        // bary[len_g], cap: output of barycentric_weights for grid (computed if bary is null)
+        //
+        // Notes
+        // -----
+        // weights[j, k] = k! bary[j] [h^k] prod_{i != j} (d_i + h) / cap^k, d_i = (around - grid[i])/cap,
+        // the Taylor coefficients are formed from prefix and suffix products (no division by d_j).
+        if (len_g < max_deriv + 1){
+            throw std::logic_error("size of grid insufficient");
+        }
+        std::vector<Real_t> b_;
+        if (!bary){
+            b_.resize(len_g);
+            cap = barycentric_weights<Real_t>(grid, len_g, &b_[0]);
+            bary = &b_[0];
+        }
+        const Real_t cap_r = 1/cap;
+        std::vector<Real_t> suffix(max_deriv + 1, 0);
+        suffix[0] = 1;
+        for (unsigned k=0; k <= max_deriv; ++k)
+            weights[k*len_g] = (k == 0) ? 1 : 0;
+        for (unsigned j=1; j < len_g; ++j){  // prefix products
+            const Real_t d = (around - grid[j-1])*cap_r;
+            for (unsigned k=max_deriv; k >= 1; --k){
+                weights[j + k*len_g] = d*weights[j - 1 + k*len_g] + weights[j - 1 + (k-1)*len_g];
+            }
+            weights[j] = d*weights[j - 1];
+        }
+        for (unsigned j=len_g; j-- > 0;){
+            for (unsigned k=max_deriv+1; k-- > 0;){
+                Real_t tmp = 0;
+                for (unsigned a=0; a <= k; ++a)
+                    tmp += weights[j + a*len_g]*suffix[k - a];
+                weights[j + k*len_g] = tmp;
+            }
+            Real_t fact = bary[j];
+            for (unsigned k=0; k <= max_deriv; ++k){
+                weights[j + k*len_g] *= fact;
+                fact *= (k + 1)*cap_r;
+            }
+            const Real_t d = (around - grid[j])*cap_r;
+            for (unsigned k=max_deriv; k >= 1; --k)
+                suffix[k] = d*suffix[k] + suffix[k-1];
+            suffix[0] *= d;
+        }
+    }
+
     // populate_weights is deprecated due to counter-intuitive parameter "nd"
     template <typename Real_t>
     void populate_weights(const Real_t z, const Real_t * const __restrict__ x, const int nd,
@@ -115,12 +214,56 @@ namespace finitediff {
         }
     }
 
+    template <typename Real_t>
+    void apply_fd_direct(const int nin, const int maxorder,
+                         const Real_t * const __restrict__ xdata,
+                         const Real_t * const __restrict__ ydata,
+                         const Real_t xtgt,
+                         Real_t * const __restrict__ out,
+                         Real_t * const __restrict__ work){
+        // Same result as apply_fd, but without forming the weights: the Taylor coefficients
+        // of the interpolating polynomial (barycentric Lagrange form) are accumulated with
+        // running products (truncated after degree maxorder).
+        //
+        // work[nin + 2*(maxorder+1)]: scratch
+        Real_t * const b = work;
+        Real_t * const prefix = work + nin;
+        Real_t * const taylor = prefix + maxorder + 1;
+        const Real_t cap = barycentric_weights<Real_t>(xdata, nin, b);
+        const Real_t cap_r = 1/cap;
+        for (int k=0; k <= maxorder; ++k){
+            prefix[k] = (k == 0) ? 1 : 0;
+            taylor[k] = 0;
+        }
+        for (int j=0; j < nin; ++j){
+            const Real_t d = (xtgt - xdata[j])*cap_r;
+            const Real_t c = b[j]*ydata[j];
+            for (int k=maxorder; k >= 1; --k){
+                taylor[k] = d*taylor[k] + taylor[k-1] + c*prefix[k];
+                prefix[k] = d*prefix[k] + prefix[k-1];
+            }
+            taylor[0] = d*taylor[0] + c*prefix[0];
+            prefix[0] *= d;
+        }
+        Real_t fact = 1;
+        for (int k=0; k <= maxorder; ++k){
+            out[k] = fact*taylor[k];
+            fact *= (k + 1)*cap_r;
+        }
+    }
+
     template <typename Real_t>
     void apply_fd(const int nin, const int maxorder,
                   const Real_t * const __restrict__ xdata,
                   const Real_t * const __restrict__ ydata,
                   const Real_t xtgt,
                   Real_t * const __restrict__ out){
+        // (the weights are only formed for short stencils, see direct_min_points)
+        if (nin >= direct_min_points && nin + 2*(maxorder+1) <= direct_max_work){
+            Real_t work[direct_max_work];
+            apply_fd_direct<Real_t>(nin, maxorder, xdata, ydata, xtgt, out, work);
+            return;
+        }
         std::vector<Real_t> c(nin * (maxorder+1));
         finitediff::calculate_weights<Real_t>(xdata, nin, maxorder, &c[0], xtgt);
         for (int j=0; j <= maxorder; ++j){
@@ -130,17 +273,139 @@ namespace finitediff {
         }
     }
 
+    template <typename Real_t>
+    void differentiate_on_grid(const Real_t * const __restrict__ grid, const unsigned len_g,
+                               const Real_t * const __restrict__ ydata, const unsigned nsets, const unsigned ldy,
+                               const unsigned max_deriv, const unsigned npoints, Real_t * const __restrict__ out,
+                               const Real_t uniform_rtol=1e-12) {
+        // Derivatives at the grid points (centred stencils of npoints points, one-sided at the ends).
+        // Runs of uniform spacing share one stencil which is applied as a convolution.
+        //
+        // Parameters
+        // ----------
+        // grid[len_g]: strictly monotonic grid
+        // ydata[nsets, ldy]: values at the grid points
+        // out[nsets, max_deriv+1, len_g]: derivatives (output argument)
+        // uniform_rtol: relative tolerance for spacings to be considered equal
+        const unsigned nin = std::min(len_g, npoints);
+        if (len_g < max_deriv + 1 || npoints < max_deriv + 1){
+            throw std::logic_error("size of grid insufficient");
+        }
+        const unsigned nbefore = (nin - 1)/2;
+        std::vector<Real_t> w(nin*(max_deriv+1)), offsets(nin);
+        for (unsigned k=0; k < nin; ++k)
+            offsets[k] = Real_t(k) - Real_t(nbefore);
+        for (unsigned node=0; node < len_g;){
+            const unsigned start = std::min(node < nbefore ? 0 : node - nbefore, len_g - nin);
+            if (start + nbefore == node && nin > 1){
+                const Real_t h0 = grid[start + 1] - grid[start];
+                const Real_t tol = uniform_rtol*(h0 < 0 ? -h0 : h0);
+                unsigned run_end = start + 1;
+                for (; run_end + 1 < len_g; ++run_end){
+                    const Real_t dh = grid[run_end + 1] - grid[run_end] - h0;
+                    if ((dh < 0 ? -dh : dh) > tol)
+                        break;
+                }
+                if (run_end >= node + (nin - 1 - nbefore)){
+                    const unsigned last = run_end - (nin - 1 - nbefore);
+                    const Real_t h = (grid[run_end] - grid[start])/(run_end - start);
+                    calculate_weights<Real_t>(&offsets[0], nin, max_deriv, &w[0], 0);
+                    Real_t scale = 1;
+                    for (unsigned j=1; j <= max_deriv; ++j){
+                        scale /= h;
+                        for (unsigned k=0; k < nin; ++k)
+                            w[k + j*nin] *= scale;
+                    }
+                    for (unsigned i=0; i < nsets; ++i){
+                        for (unsigned j=0; j <= max_deriv; ++j){
+                            Real_t * const o = out + (i*(max_deriv+1) + j)*len_g;
+                            const Real_t * const y = ydata + i*ldy + node - nbefore;
+                            for (unsigned n=node; n <= last; ++n)
+                                o[n] = w[j*nin]*y[n - node];
+                            for (unsigned k=1; k < nin; ++k){
+                                for (unsigned n=node; n <= last; ++n)
+                                    o[n] += w[k + j*nin]*y[n - node + k];
+                            }
+                        }
+                    }
+                    node = last + 1;
+                    continue;
+                }
+            }
+            calculate_weights<Real_t>(grid + start, nin, max_deriv, &w[0], grid[node]);
+            for (unsigned i=0; i < nsets; ++i){
+                for (unsigned j=0; j <= max_deriv; ++j){
+                    Real_t tmp = 0;
+                    for (unsigned k=0; k < nin; ++k)
+                        tmp += w[k + j*nin]*ydata[i*ldy + start + k];
+                    out[(i*(max_deriv+1) + j)*len_g + node] = tmp;
+                }
+            }
+            ++node;
+        }
+    }
+
+    template <typename Real_t>
+    void apply_fd_periodic(const Real_t * const __restrict__ grid, const unsigned len_g, const Real_t period,
+                           const Real_t * const __restrict__ ydata, const Real_t xtgt,
+                           const unsigned ntail, const unsigned nhead, const unsigned maxorder,
+                           Real_t * const __restrict__ out) {
+        // Derivatives at xtgt (anywhere) of a periodic function sampled at one period (grid, increasing),
+        // the stencil (same as for finitediff_interpolate_by_finite_diff) wraps around the ends of grid.
+        //
+        // Parameters
+        // ----------
+        // grid[len_g], ydata[len_g]: one period
+        // period: length of the period (> grid[len_g-1] - grid[0])
+        // out[maxorder+1]: estimates (output argument)
+        const unsigned nin = ntail + nhead;
+        if (nin < maxorder + 1 || len_g < nin){
+            throw std::logic_error("size of grid insufficient");
+        }
+        if (!(period > grid[len_g - 1] - grid[0])){
+            throw std::logic_error("period too short");
+        }
+        Real_t x = xtgt - period*std::floor((xtgt - grid[0])/period);
+        if (x < grid[0] || x >= grid[0] + period)
+            x = grid[0]; // rounding, e.g. for xtgt == grid[0] +/- period
+        const int start = int(std::upper_bound(grid, grid + len_g, x) - grid) - 1 - int(nhead);
+        std::vector<Real_t> sgrid(nin), w(nin*(maxorder+1));
+        std::vector<unsigned> idx(nin);
+        for (unsigned k=0; k < nin; ++k){
+            int i = start + int(k);
+            Real_t shift = 0;
+            for (; i < 0; i += len_g)
+                shift -= period;
+            for (; i >= int(len_g); i -= len_g)
+                shift += period;
+            idx[k] = i;
+            sgrid[k] = grid[i] + shift;
+        }
+        calculate_weights<Real_t>(&sgrid[0], nin, maxorder, &w[0], x);
+        for (unsigned j=0; j <= maxorder; ++j){
+            out[j] = 0;
+            for (unsigned k=0; k < nin; ++k)
+                out[j] += w[k + j*nin]*ydata[idx[k]];
+        }
+    }
+
 // Pre-processor macro __cplusplus == 201103L in ISO C++11 compliant compilers. (e.g. GCC >= 4.7.0)
 #if __cplusplus > 199711L
+    enum class WeightsEngine { fornberg, barycentric };
+
     template<typename Real_t, template<typename, typename...> class Cont, typename... Args>
-    Cont<Real_t, Args...> generate_weights(const Cont<Real_t, Args...>& grid, int maxorder=-1, const Real_t around=0){
+    Cont<Real_t, Args...> generate_weights(const Cont<Real_t, Args...>& grid, int maxorder=-1, const Real_t around=0,
+                                           const WeightsEngine engine=WeightsEngine::fornberg){
         // Cont<Real_t, Args...> must have contiguous memory storage (e.g. std::vector)
         const unsigned maxorder_ = (maxorder < 0) ? (grid.size()+1)/2 : maxorder;
         Cont<Real_t, Args...> coeffs(grid.size()*(maxorder_+1));
         if (grid.size() < maxorder_ + 1){
             throw std::logic_error("size of grid insufficient");
         }
-        calculate_weights<Real_t>(&grid[0], grid.size(), maxorder_, &coeffs[0], around);
+        if (engine == WeightsEngine::barycentric)
+            calculate_weights_barycentric<Real_t>(&grid[0], grid.size(), maxorder_, &coeffs[0], around);
+        else
+            calculate_weights<Real_t>(&grid[0], grid.size(), maxorder_, &coeffs[0], around);
         return coeffs;
     }
 #endif
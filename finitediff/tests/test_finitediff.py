@@ -3,11 +3,21 @@
 from __future__ import print_function, division, absolute_import, unicode_literals
 
 import numpy as np
+import pytest
 
 from finitediff import (
     interpolate_by_finite_diff,
+    differentiate_on_grid,
+    differentiate_function,
+    color_columns,
+    sparse_jacobian,
     derivatives_at_point_by_finite_diff,
+    derivatives_at_points_by_finite_diff,
     get_weights,
+    get_weights_at_points,
+    write_weights_file,
+    MappedWeights,
+    MovingGridPlan,
 )
 
 
@@ -269,6 +279,296 @@ def test_interpolate_by_finite_diff__multiple_ydata__data():
         assert np.allclose(yexact, y[..., ci], rtol=tol, atol=tol)
 
 
+def test_interpolate_by_finite_diff__multiple_ydata__grid_major():
+    xarr = np.linspace(-1.5, 1.7, 53)
+    xtest = np.linspace(-1.4, 1.6, 57)
+    yarr = np.array([i * np.exp(xarr) + i for i in range(1, 5)])
+    ref = interpolate_by_finite_diff(xarr, yarr, xtest, maxorder=3, ntail=4, nhead=4)
+    yarr_f = np.asfortranarray(yarr)
+    assert not yarr_f.flags.c_contiguous
+    res = interpolate_by_finite_diff(xarr, yarr_f, xtest, maxorder=3, ntail=4, nhead=4)
+    assert res.shape == ref.shape
+    # summation order differs between layouts (and may use FMA), weights grow with order
+    for ci in range(ref.shape[2]):
+        tol = 10 ** -(13 - ci * 2)
+        assert np.allclose(res[..., ci], ref[..., ci], rtol=tol, atol=tol)
+
+
+def test_get_weights_at_points():
+    grid = np.array([0.0, 0.5, 1.1, 1.5, 2.2])
+    xtgts = np.array([0.1, 0.7, 1.3, 2.0])
+    c = get_weights_at_points(grid, xtgts, maxorder=2)
+    assert c.shape == (4, 5, 3)
+    for i, xtgt in enumerate(xtgts):
+        assert np.allclose(c[i], get_weights(grid, xtgt, maxorder=2))
+
+    out = np.zeros((4, 3, 5)).transpose(0, 2, 1)
+    res = get_weights_at_points(grid, xtgts, maxorder=2, out=out)
+    assert res is out
+    assert np.allclose(out, c)
+
+
+def test_derivatives_at_points_by_finite_diff():
+    x = np.linspace(0, 2, 9)
+    ydata = np.array([np.sin(x), np.cos(x)])
+    xtgts = np.array([0.3, 0.9, 1.7])
+    ref = np.array(
+        [derivatives_at_point_by_finite_diff(x, ydata, xt, 2) for xt in xtgts]
+    )
+    res = derivatives_at_points_by_finite_diff(x, ydata, xtgts, 2)
+    assert res.shape == (3, 2, 3)
+    assert np.allclose(res, ref)
+
+    out = np.empty((3, 2, 3))
+    assert derivatives_at_points_by_finite_diff(x, ydata, xtgts, 2, out=out) is out
+    assert np.allclose(out, ref)
+
+
+def test_derivatives_at_points_by_finite_diff__threads():
+    from concurrent.futures import ThreadPoolExecutor
+
+    x = np.linspace(0, 2, 41)
+    ydata = np.array([k * np.exp(x) for k in range(1, 6)])
+    chunks = [np.linspace(0.1, 1.9, 50) + 1e-3 * i for i in range(8)]
+    with ThreadPoolExecutor(4) as executor:
+        results = list(
+            executor.map(
+                lambda xt: derivatives_at_points_by_finite_diff(x, ydata, xt, 1), chunks
+            )
+        )
+    for xt, res in zip(chunks, results):
+        assert np.allclose(res[:, 0, 0], np.exp(xt))
+        assert np.allclose(res[:, 4, 1], 5 * np.exp(xt))
+
+
+def test_get_weights__barycentric():
+    grid = np.linspace(0, 3, 41) + 0.01 * np.sin(np.arange(41))
+    xtgts = np.array([grid[20], grid[20] + 1e-14, 1.2345])
+    for xtgt in xtgts:
+        ref = get_weights(grid, xtgt, maxorder=3)
+        res = get_weights(grid, xtgt, maxorder=3, engine="barycentric")
+        assert np.allclose(res, ref, rtol=1e-8, atol=1e-8)
+    res = get_weights_at_points(grid, xtgts, maxorder=3, engine="barycentric")
+    assert np.allclose(
+        res, get_weights_at_points(grid, xtgts, maxorder=3), rtol=1e-8, atol=1e-8
+    )
+
+
+def test_get_weights__underresolved():
+    # orders which the grid cannot resolve get zero weights
+    for engine in ("fornberg", "barycentric"):
+        res = get_weights([0.0, 1.0], 0.5, maxorder=2, engine=engine)
+        assert np.allclose(res, [[0.5, -1, 0], [0.5, 1, 0]])
+        res = get_weights_at_points([0.0, 1.0], [0.5, 0.25], maxorder=3, engine=engine)
+        assert np.allclose(res[1], [[0.75, -1, 0, 0], [0.25, 1, 0, 0]])
+
+
+def test_interpolate_by_finite_diff__engine_env(monkeypatch):
+    x = np.linspace(0, 2, 40) + 0.01 * np.sin(np.arange(40))
+    y = np.exp(x)
+    xout = np.linspace(0.1, 1.9, 57)  # stencils move one grid point at a time
+    ref = interpolate_by_finite_diff(x, y, xout, maxorder=2, ntail=10, nhead=10)
+    for engine in ("fornberg", "barycentric", "auto"):
+        monkeypatch.setenv("FINITEDIFF_WEIGHTS_ENGINE", engine)
+        res = interpolate_by_finite_diff(x, y, xout, maxorder=2, ntail=10, nhead=10)
+        assert np.allclose(res, ref, rtol=1e-8, atol=1e-8)
+        plan = MovingGridPlan(x, xout, maxorder=2, ntail=10, nhead=10)
+        assert np.allclose(plan.apply(y), ref[:, None, :], rtol=1e-8, atol=1e-8)
+    monkeypatch.setenv("FINITEDIFF_WEIGHTS_ENGINE", "bogus")
+    with pytest.raises(ValueError):
+        interpolate_by_finite_diff(x, y, xout, maxorder=2)
+
+
+def test_MappedWeights(tmp_path):
+    xarr = np.linspace(-1.5, 1.7, 53)
+    xtest = np.linspace(-1.4, 1.6, 57)
+    yarr = np.array([i * np.exp(xarr) for i in range(1, 4)])
+    path = str(tmp_path / "weights.bin")
+    write_weights_file(path, xarr, xtest, maxorder=3, ntail=4, nhead=4)
+    mw = MappedWeights(path)
+    assert mw.maxorder == 3 and mw.len_grid == xarr.size
+    assert mw.weights.shape == (xtest.size, 4, 8)
+    assert not mw.weights.flags.writeable
+    assert np.all(mw.xtgts == xtest)
+    j = mw.starts[10]
+    assert np.allclose(
+        mw.weights[10].T, get_weights(xarr[j : j + 8], xtest[10], maxorder=3)
+    )
+    ref = interpolate_by_finite_diff(xarr, yarr, xtest, maxorder=3, ntail=4, nhead=4)
+    res = mw.apply(yarr)
+    # interpolate_by_finite_diff may pick another (tuned) kernel: per-order tolerances
+    for ci in range(ref.shape[2]):
+        tol = 10 ** -(13 - ci * 2)
+        assert np.allclose(res[..., ci], ref[..., ci], rtol=tol, atol=tol)
+    del mw
+
+    with open(path, "r+b") as fh:
+        fh.write(b"X")
+    try:
+        MappedWeights(path)
+    except ValueError:
+        pass
+    else:
+        assert False
+
+
+def test_MovingGridPlan():
+    x = np.linspace(0, 3, 61)
+    xout = np.linspace(0.1, 2.9, 47)
+    plan = MovingGridPlan(x, xout, maxorder=2, ntail=3, nhead=3, rtol=1e-8)
+    assert plan.update(x) == 0
+    x2 = x.copy()
+    x2[30] += 0.01
+    x2[5] += 1e-13
+    nref = plan.update(x2)
+    assert 0 < nref < 10
+    y = np.array([np.sin(x2), np.cos(x2)])
+    ref = interpolate_by_finite_diff(x2, y, xout, maxorder=2, ntail=3, nhead=3)
+    assert np.allclose(plan.apply(y), ref, rtol=1e-9, atol=1e-9)
+    assert plan.update(x2, xout + 0.02) == xout.size
+
+
+def test_MovingGridPlan__threads():
+    from concurrent.futures import ThreadPoolExecutor
+
+    x = np.linspace(0, 3, 301)
+    grids = [x, x + 0.05 * np.sin(3 * x)]
+    xout = np.linspace(0.1, 2.9, 997)
+    y = np.array([np.sin(x)])
+    refs = [
+        interpolate_by_finite_diff(g, y, xout, maxorder=1, ntail=3, nhead=3)
+        for g in grids
+    ]
+    plan = MovingGridPlan(x, xout, maxorder=1, ntail=3, nhead=3)
+
+    def work(i):
+        plan.update(grids[i % 2])
+        res = plan.apply(y)
+        # another thread may have updated in between, but never half-way
+        return any(np.allclose(res, ref, rtol=1e-12, atol=1e-12) for ref in refs)
+
+    with ThreadPoolExecutor(4) as pool:
+        assert all(pool.map(work, range(200)))
+
+
+def test_differentiate_on_grid():
+    x = np.concatenate((np.linspace(0, 1, 101), 1 + np.linspace(0.01, 0.5, 30) ** 1.5))
+    y = np.array([np.sin(x), np.exp(x)])
+    res = differentiate_on_grid(x, y, maxorder=2, npoints=5)
+    assert res.shape == (2, 3, x.size)
+    for i in range(x.size):
+        j = min(max(i - 2, 0), x.size - 5)
+        ref = derivatives_at_points_by_finite_diff(
+            x[j : j + 5], y[:, j : j + 5], x[i : i + 1], 2
+        )
+        assert np.allclose(res[:, :, i], ref[0], rtol=1e-9, atol=1e-7)
+    assert np.allclose(res[0, 1, :101], np.cos(x[:101]), atol=1e-7)
+    out = np.empty((1, 2, x.size))
+    assert differentiate_on_grid(x, x**2, out=out) is out
+    assert np.allclose(out[0, 1], 2 * x)
+
+
+def test_interpolate_by_finite_diff__periodic():
+    period = 2 * np.pi
+    x = np.linspace(0, period, 40, endpoint=False)
+    y = np.array([np.sin(x), np.cos(x)])
+    xout = np.array([-7.0, -0.01, 0.0, 3.0, 6.25, 13.0])
+    res = interpolate_by_finite_diff(
+        x, y, xout, maxorder=1, ntail=3, nhead=3, period=period
+    )
+    assert res.shape == (6, 2, 2)
+    assert np.allclose(res[:, 0, 0], np.sin(xout), atol=1e-6)
+    assert np.allclose(res[:, 0, 1], np.cos(xout), atol=1e-5)
+    assert np.allclose(res[:, 1, 1], -np.sin(xout), atol=1e-5)
+    # grid-major ydata
+    res_f = interpolate_by_finite_diff(
+        x, np.asfortranarray(y), xout, maxorder=1, ntail=3, nhead=3, period=period
+    )
+    assert np.allclose(res_f, res)
+    # targets one period apart get the same stencil
+    for x0 in (0.1, 2.069):
+        xp = np.array([x0, x0 + period, x0 - period])
+        res_p = interpolate_by_finite_diff(
+            x + x0, y, xp, maxorder=1, ntail=3, nhead=3, period=period
+        )
+        assert np.allclose(res_p[1:], res_p[0], rtol=0, atol=1e-12)
+    with pytest.raises(ValueError):
+        interpolate_by_finite_diff(x, y, xout, period=1.0)
+
+
+def test_differentiate_function():
+    x = np.array([[-1.0, 0.0], [0.5, 3.0]])
+    calls = []
+
+    def f(xs):
+        calls.append(xs.size)
+        return np.sin(xs)
+
+    d, err, info = differentiate_function(f, x, full_output=True)
+    assert d.shape == x.shape and err.shape == x.shape
+    assert np.allclose(d, np.cos(x), rtol=1e-10, atol=1e-12)
+    assert np.all(err < 1e-8)
+    assert info["ncalls"] == len(calls) and info["nfev"] == sum(calls)
+    assert calls[0] == 3 * x.size and all(n <= 2 * x.size for n in calls[1:])
+    d3 = differentiate_function(np.exp, [0.0, 1.0], deriv=3, npoints=5)
+    assert np.allclose(d3, np.exp([0.0, 1.0]), rtol=1e-8)
+
+    def bad(xs):
+        raise KeyError("oops")
+
+    with pytest.raises(KeyError):
+        differentiate_function(bad, x)
+    with pytest.raises(ValueError):
+        differentiate_function(np.exp, x, npoints=4)
+
+
+def test_sparse_jacobian():
+    n = 30
+    x0 = np.linspace(-1, 2, n)
+
+    def f(X):
+        Y = np.sin(X)
+        Y[:, 1:] += X[:, :-1] ** 2
+        Y[:, :-1] += X[:, :-1] * X[:, 1:]
+        return Y
+
+    pattern = np.eye(n) + np.eye(n, k=1) + np.eye(n, k=-1)
+    colors = color_columns(pattern)
+    assert colors.max() == 2
+    (data, indices, indptr), info = sparse_jacobian(f, x0, pattern, full_output=True)
+    assert info == dict(ncolors=3, nfev=6, ncalls=1)
+    ref = (
+        np.diag(np.cos(x0) + np.append(x0[1:], 0))
+        + np.diag(2 * x0[:-1], k=-1)
+        + np.diag(x0[:-1], k=1)
+    )
+    dense = np.zeros((n, n))
+    for i in range(n):
+        dense[i, indices[indptr[i] : indptr[i + 1]]] = data[indptr[i] : indptr[i + 1]]
+    assert np.allclose(dense, ref, atol=1e-8)
+    # one-sided fourth order stencil reusing f(x0), in batches of at most 5 points
+    (data2, _, _), info2 = sparse_jacobian(
+        f,
+        x0,
+        pattern,
+        offsets=(0, 1, 2, 3, 4),
+        f0=f(x0[None, :])[0],
+        colors=colors,
+        max_batch=5,
+        full_output=True,
+    )
+    assert info2 == dict(ncolors=3, nfev=12, ncalls=3)
+    assert np.allclose(data2, data, atol=1e-6)
+    with pytest.raises(ValueError):
+        sparse_jacobian(f, x0[1:], pattern)
+    # invalid colourings and stencils are rejected before any evaluation
+    for bad_colors in ([0] * n, [-1] + list(colors[1:])):
+        with pytest.raises(ValueError):
+            sparse_jacobian(f, x0, pattern, colors=bad_colors)
+    with pytest.raises(ValueError):
+        sparse_jacobian(f, x0, pattern, offsets=(-1, 1, 1))
+
+
 if __name__ == "__main__":
     test_interpolate_by_finite_diff()
     test_derivatives_at_point_by_finite_diff()
@@ -3,6 +3,7 @@
 
 import io
 import os
+import platform
 import pprint
 import re
 import shutil
@@ -111,11 +112,17 @@ if (
 
     from setuptools.extension import Extension
 
+    define_macros = []
+    if sys.platform.startswith("linux") and platform.machine() == "x86_64":
+        # kernels cloned for AVX-512/AVX2 (only acted upon by GCC, see src/finitediff_c.c)
+        define_macros.append(("FINITEDIFF_MULTIVERSION", None))
+
     ext_modules = [
         Extension(
             "%s.%s" % (pkg_name, basename),
             [_src["pyx" if USE_CYTHON else "c"]],
             include_dirs=include_dirs,
+            define_macros=define_macros,
         )
     ]
     if USE_CYTHON:
@@ -1,14 +1,42 @@
+#include <stdio.h> /* fopen, fgets, sscanf (tuning file) */
 #include <stdlib.h> /* malloc & free */
 #include <string.h> /* memset */
+#include <math.h> /* floor */
+#include <time.h> /* clock */
 #include "finitediff_c.h"
 #include "newton_interval.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define FINITEDIFF_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h> /* SRWLOCK (tuning table) */
+#else
+#include <pthread.h> /* pthread_mutex_t (tuning table) */
+#endif
+
 #ifdef FINITEDIFF_OPENMP
 #include <omp.h>
 #else
 #define omp_get_thread_num() 0
+#define omp_get_max_threads() 1
+#endif
+
+/* Multiple ISA versions of the kernels, selected via CPUID when the library is loaded (GCC ifunc) */
+#if defined(FINITEDIFF_MULTIVERSION) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 \
+    && defined(__x86_64__) && defined(__linux__)
+  #define FINITEDIFF_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+  #define FINITEDIFF_TARGET_CLONES
 #endif
 
+FINITEDIFF_TARGET_CLONES
 void finitediff_calculate_weights(
     FINITEDIFF_REAL * const FINITEDIFF_RESTRICT w,
     const int ldw,
@@ -49,6 +77,126 @@ void finitediff_calculate_weights(
     }
 }
 
+FINITEDIFF_REAL finitediff_barycentric_weights(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT b,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_g
+)
+{
+    int i, j;
+    FINITEDIFF_REAL lo = grid[0], hi = grid[0], cap, cap_r, prod;
+    for (i = 1; i < len_g; ++i){
+        lo = FINITEDIFF_MIN(lo, grid[i]);
+        hi = FINITEDIFF_MAX(hi, grid[i]);
+    }
+    /* scaling by the capacity (length/4) of the interval keeps the products away from over/underflow */
+    cap = (hi > lo) ? (hi - lo)/4 : 1;
+    cap_r = 1/cap;
+    /* i == j is skipped by splitting the loop: no branch in this O(len_g**2) part, which
+       finitediff_apply_fd_direct runs on every call */
+    for (j = 0; j < len_g; ++j){
+        prod = 1;
+        for (i = 0; i < j; ++i)
+            prod *= (grid[j] - grid[i])*cap_r;
+        for (i = j + 1; i < len_g; ++i)
+            prod *= (grid[j] - grid[i])*cap_r;
+        b[j] = 1/prod;
+    }
+    return cap;
+}
+
+void finitediff_barycentric_weights_shift(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT b,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_g,
+    const FINITEDIFF_REAL dropped,
+    const int direction,
+    const FINITEDIFF_REAL cap
+)
+{
+    /* b[k] = 1/prod_{i != k} (x_k - x_i)/cap: the factor of the dropped point is replaced by that of the new one */
+    int k;
+    FINITEDIFF_REAL prod = 1, xnew;
+    const FINITEDIFF_REAL cap_r = 1/cap;
+    if (direction > 0) {
+        xnew = grid[len_g - 1];
+        for (k = 0; k < len_g - 1; ++k){
+            b[k] = b[k + 1]*(grid[k] - dropped)/(grid[k] - xnew);
+            prod *= (xnew - grid[k])*cap_r;
+        }
+        b[len_g - 1] = 1/prod;
+    } else {
+        xnew = grid[0];
+        for (k = len_g - 1; k > 0; --k){
+            b[k] = b[k - 1]*(grid[k] - dropped)/(grid[k] - xnew);
+            prod *= (xnew - grid[k])*cap_r;
+        }
+        b[0] = 1/prod;
+    }
+}
+
+FINITEDIFF_TARGET_CLONES
+void finitediff_calculate_weights_barycentric(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT w,
+    const int ldw,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_g,
+    const int max_deriv,
+    const FINITEDIFF_REAL around,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT b,
+    const FINITEDIFF_REAL cap,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT work
+)
+{
+    /*
+      w[j, k] = k! b[j] [h^k] prod_{i != j} (d_i + h) / cap^k,  d_i = (around - grid[i])/cap
+
+      The Taylor coefficients of the products are formed from prefix (stored in ``w``) and
+      suffix (``work``) products, i.e. without division by d_j, which makes targets at or
+      close to grid points unproblematic.
+    */
+    int j, k, a, mk;
+    FINITEDIFF_REAL d, tmp, fact;
+    const FINITEDIFF_REAL cap_r = 1/cap;
+    for (k = 0; k <= max_deriv; ++k){
+        w[k*ldw] = 0;
+        work[k] = 0;
+    }
+    w[0] = 1;
+    work[0] = 1;
+    for (j = 1; j < len_g; ++j){
+        d = (around - grid[j-1])*cap_r;
+        mk = FINITEDIFF_MIN(j, max_deriv);
+        for (k = max_deriv; k > mk; --k){
+            w[j + k*ldw] = 0;
+        }
+        for (k = mk; k >= 1; --k){
+            w[j + k*ldw] = d*w[j - 1 + k*ldw] + w[j - 1 + (k-1)*ldw];
+        }
+        w[j] = d*w[j - 1];
+    }
+    for (j = len_g - 1; j >= 0; --j){
+        for (k = max_deriv; k >= 0; --k){
+            tmp = 0;
+            for (a = 0; a <= k; ++a){
+                tmp += w[j + a*ldw]*work[k - a];
+            }
+            w[j + k*ldw] = tmp;
+        }
+        fact = b[j];
+        for (k = 0; k <= max_deriv; ++k){
+            w[j + k*ldw] *= fact;
+            fact *= (k + 1)*cap_r;
+        }
+        d = (around - grid[j])*cap_r;
+        for (k = max_deriv; k >= 1; --k){
+            work[k] = d*work[k] + work[k-1];
+        }
+        work[0] *= d;
+    }
+}
+
+FINITEDIFF_TARGET_CLONES
 void finitediff_apply_fd(
     FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
     const int ld_out,
@@ -74,6 +222,56 @@ void finitediff_apply_fd(
     }
 }
 
+void finitediff_apply_fd_direct(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int ld_out,
+    const int nsets,
+    const int max_deriv,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ldy,
+    const FINITEDIFF_REAL xtgt,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT work
+)
+{
+    /*
+      p(xtgt + h) = sum_j y_j b_j P_j(h) S_j(h),  P_j = prod_{i<j} (d_i + h),  S_j = prod_{i>j} (d_i + h)
+      (d_i = (xtgt - grid[i])/cap) is accumulated Horner-like, T <- T*(d_j + h) + y_j b_j P_j,
+      with all polynomials truncated after h**max_deriv. Only the barycentric weights
+      need divisions (len_grid of them).
+    */
+    int i, j, k;
+    FINITEDIFF_REAL d, c, fact, cap, cap_r;
+    FINITEDIFF_REAL * const b = work;                         /* barycentric weights */
+    FINITEDIFF_REAL * const prefix = work + len_grid;         /* P_j */
+    FINITEDIFF_REAL * const taylor = prefix + max_deriv + 1;  /* T */
+    cap = finitediff_barycentric_weights(b, grid, len_grid);
+    cap_r = 1/cap;
+    for (i = 0; i < nsets; ++i){
+        for (k = 0; k <= max_deriv; ++k){
+            prefix[k] = 0;
+            taylor[k] = 0;
+        }
+        prefix[0] = 1;
+        for (j = 0; j < len_grid; ++j){
+            d = (xtgt - grid[j])*cap_r;
+            c = b[j]*ydata[i*ldy + j];
+            for (k = max_deriv; k >= 1; --k){
+                taylor[k] = d*taylor[k] + taylor[k-1] + c*prefix[k];
+                prefix[k] = d*prefix[k] + prefix[k-1];
+            }
+            taylor[0] = d*taylor[0] + c*prefix[0];
+            prefix[0] *= d;
+        }
+        fact = 1;
+        for (k = 0; k <= max_deriv; ++k){
+            out[i*ld_out + k] = fact*taylor[k];
+            fact *= (k + 1)*cap_r;
+        }
+    }
+}
+
 int finitediff_calc_and_apply_fd(
     FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
     const int ld_out,
@@ -88,28 +286,150 @@ int finitediff_calc_and_apply_fd(
 {
     int status = FINITEDIFF_STATUS_SUCCESS;
     FINITEDIFF_REAL * w;
+    FINITEDIFF_REAL work[FINITEDIFF_DIRECT_MAX_WORK];
     const int ldw=len_grid;
+    if (len_grid < max_deriv + 1){
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
+    }
+    if (ld_out < max_deriv + 1) {
+        return FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION;
+    }
+    if (len_grid >= nsets*FINITEDIFF_DIRECT_MIN_POINTS_PER_SET &&
+        FINITEDIFF_DIRECT_WORK_LEN(len_grid, max_deriv) <= FINITEDIFF_DIRECT_MAX_WORK) {
+        /* no weights matrix (and no heap) */
+        finitediff_apply_fd_direct(out, ld_out, nsets, max_deriv, len_grid, grid, ydata, ldy, xtgt, work);
+        goto exit0;
+    }
     w = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*ldw*(max_deriv+1));
     if (!w) {
         status = FINITEDIFF_STATUS_ERR_BAD_ALLOC;
         goto exit0;
     }
-    if (len_grid < max_deriv + 1){
-        status = FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
-        goto exit1;
-    }
-    if (ld_out < max_deriv + 1) {
-        status = FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION;
-        goto exit1;
-    }
     finitediff_calculate_weights(w, ldw, grid, len_grid, max_deriv, xtgt);
     finitediff_apply_fd(out, ld_out, w, ldw, nsets, max_deriv, len_grid, ydata, ldy);
-exit1:
     free(w);
 exit0:
     return status;
 }
 
+FINITEDIFF_TARGET_CLONES
+static void apply_fd_set_grid_strided(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int elem_strides_out_set,
+    const int elem_strides_out_deriv,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT w,
+    const int ldw,
+    const int nsets,
+    const int max_deriv,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ldy
+)
+{
+    /* ydata[set_idx, grid_idx]: dot products along the grid, output written with strides */
+    int i, j, k;
+    FINITEDIFF_REAL tmp;
+    for (i=0; i<nsets; ++i){
+        for (j=0; j <= max_deriv; ++j){
+            tmp = 0;
+            for (k=0; k<len_grid; ++k){
+                tmp += w[k + j*ldw] * ydata[ldy*i + k];
+            }
+            out[i*elem_strides_out_set + j*elem_strides_out_deriv] = tmp;
+        }
+    }
+}
+
+FINITEDIFF_TARGET_CLONES
+static void apply_fd_set_grid_blocked(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int elem_strides_out_set,
+    const int elem_strides_out_deriv,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT w,
+    const int ldw,
+    const int nsets,
+    const int max_deriv,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ldy
+)
+{
+    /* ydata[set_idx, grid_idx]: four sets at a time share each load of the weights */
+    int i, j, k;
+    FINITEDIFF_REAL wk, t0, t1, t2, t3;
+    const FINITEDIFF_REAL *y0, *y1, *y2, *y3;
+    for (i=0; i + 4 <= nsets; i += 4){
+        y0 = ydata + ldy*i;
+        y1 = y0 + ldy;
+        y2 = y1 + ldy;
+        y3 = y2 + ldy;
+        for (j=0; j <= max_deriv; ++j){
+            t0 = t1 = t2 = t3 = 0;
+            for (k=0; k<len_grid; ++k){
+                wk = w[k + j*ldw];
+                t0 += wk*y0[k];
+                t1 += wk*y1[k];
+                t2 += wk*y2[k];
+                t3 += wk*y3[k];
+            }
+            out[i*elem_strides_out_set + j*elem_strides_out_deriv] = t0;
+            out[(i+1)*elem_strides_out_set + j*elem_strides_out_deriv] = t1;
+            out[(i+2)*elem_strides_out_set + j*elem_strides_out_deriv] = t2;
+            out[(i+3)*elem_strides_out_set + j*elem_strides_out_deriv] = t3;
+        }
+    }
+    if (i < nsets) {
+        apply_fd_set_grid_strided(out + i*elem_strides_out_set, elem_strides_out_set, elem_strides_out_deriv,
+                                  w, ldw, nsets - i, max_deriv, len_grid, ydata + ldy*i, ldy);
+    }
+}
+
+FINITEDIFF_TARGET_CLONES
+static void apply_fd_grid_set(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int elem_strides_out_set,
+    const int elem_strides_out_deriv,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT acc, /* scratch: (max_deriv+1)*nsets */
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT w,
+    const int ldw,
+    const int nsets,
+    const int max_deriv,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ldy
+)
+{
+    /* ydata[grid_idx, set_idx]: each row of ydata is streamed once, unit stride across sets */
+    int i, j, k;
+    FINITEDIFF_REAL wk;
+    FINITEDIFF_REAL * FINITEDIFF_RESTRICT accj;
+    const FINITEDIFF_REAL * FINITEDIFF_RESTRICT yk;
+    memset(acc, 0, sizeof(FINITEDIFF_REAL)*nsets*(max_deriv+1));
+    for (k=0; k<len_grid; ++k){
+        yk = ydata + k*ldy;
+        for (j=0; j <= max_deriv; ++j){
+            wk = w[k + j*ldw];
+            accj = acc + j*nsets;
+            for (i=0; i<nsets; ++i){
+                accj[i] += wk*yk[i];
+            }
+        }
+    }
+    if (elem_strides_out_deriv == 1) {
+        for (i=0; i<nsets; ++i){
+            for (j=0; j <= max_deriv; ++j){
+                out[i*elem_strides_out_set + j] = acc[j*nsets + i];
+            }
+        }
+    } else {
+        for (j=0; j <= max_deriv; ++j){
+            for (i=0; i<nsets; ++i){
+                out[i*elem_strides_out_set + j*elem_strides_out_deriv] = acc[j*nsets + i];
+            }
+        }
+    }
+}
+
 int finitediff_interpolate_by_finite_diff(
     FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out, /* C-order: out[tgt_idx, set_idx, deriv_idx] */
     const int len_targets,
@@ -126,55 +446,1499 @@ int finitediff_interpolate_by_finite_diff(
     const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts /* len(xtgts) == len_targets */
 )
 {
-    FINITEDIFF_REAL xtgt;
-    int tgt_idx, j=0, status=0, n_threads=1;
+    return finitediff_interpolate_by_finite_diff_layout(
+        out, len_targets, nsets, max_deriv, FINITEDIFF_OUT_TGT_SET_DERIV, elem_strides_out_0, elem_strides_out_1,
+        ntail, nhead, grid, len_grid, ydata, FINITEDIFF_YDATA_SET_GRID, ldy, xtgts);
+}
+
+/* Index of first grid point in the stencil of ``xtgt`` (``guess``: previous interval) */
+static int stencil_start_(
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL xtgt,
+    const int guess,
+    const int nhead,
+    const int nin
+)
+{
+    const int j = get_interval_from_guess(grid, len_grid, xtgt, guess) - nhead;
+    return FINITEDIFF_MAX(0, FINITEDIFF_MIN(j, len_grid - nin));
+}
+
+/* Barycentric weights held for one stencil (per thread) */
+typedef struct {
+    int start;             /* start of the stencil (below any stencil start: none) */
+    int n_shifts;          /* O(nin) updates since the weights were computed in full */
+    FINITEDIFF_REAL first; /* end points of the stencil */
+    FINITEDIFF_REAL last;
+    FINITEDIFF_REAL cap;
+} bary_stencil_;
+
+/* Barycentric weights ``b`` of stencil ``sg`` (starting at ``start``, same grid as before): kept when
+   the stencil is unchanged, shifted in O(nin) when it moved by one point, otherwise (and after nin
+   shifts, bounding rounding and rescaling the capacity) computed in full */
+static FINITEDIFF_REAL bary_stencil_weights_(
+    bary_stencil_ * const st,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT b,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT sg,
+    const int nin,
+    const int start
+)
+{
+    if (start == st->start)
+        return st->cap;
+    if ((start == st->start + 1 || start == st->start - 1) && st->n_shifts < nin) {
+        finitediff_barycentric_weights_shift(b, sg, nin, (start > st->start) ? st->first : st->last,
+                                             start - st->start, st->cap);
+        ++st->n_shifts;
+    } else {
+        st->cap = finitediff_barycentric_weights(b, sg, nin);
+        st->n_shifts = 0;
+    }
+    st->start = start;
+    st->first = sg[0];
+    st->last = sg[nin - 1];
+    return st->cap;
+}
+
+/* Start of the periodic stencil of ``xtgt`` (reduced to [grid[0], grid[0] + period)), may lie outside [0, len_grid - nin] */
+static int periodic_stencil_start_(
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL xtgt,
+    int * const guess,
+    const int nhead
+)
+{
+    const int i = get_interval_from_guess(grid, len_grid, xtgt, *guess);
+    *guess = FINITEDIFF_MAX(i, 0);
+    return i - nhead;
+}
+
+/* Stencil points start..start+nin-1 (indices modulo len_grid) shifted by multiples of ``period`` */
+static void periodic_stencil_grid_(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT sgrid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL period,
+    const int start,
+    const int nin
+)
+{
+    int k, idx;
+    FINITEDIFF_REAL shift;
+    for (k=0; k<nin; ++k){
+        idx = start + k;
+        shift = 0;
+        while (idx < 0) {
+            idx += len_grid;
+            shift -= period;
+        }
+        while (idx >= len_grid) {
+            idx -= len_grid;
+            shift += period;
+        }
+        sgrid[k] = grid[idx] + shift;
+    }
+}
+
+static void apply_fd_wrapped(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int elem_strides_out_set,
+    const int elem_strides_out_deriv,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT w,
+    const int ldw,
+    const int nsets,
+    const int max_deriv,
+    const int nin,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const int start,
+    const int len_grid
+)
+{
+    /* stencil crossing the end of a periodic grid: grid indices taken modulo len_grid */
+    int i, j, k, g;
+    FINITEDIFF_REAL tmp;
+    const int start0 = ((start % len_grid) + len_grid) % len_grid;
+    const int set_stride = (ydata_layout == FINITEDIFF_YDATA_GRID_SET) ? 1 : ldy;
+    const int grid_stride = (ydata_layout == FINITEDIFF_YDATA_GRID_SET) ? ldy : 1;
+    for (i=0; i<nsets; ++i){
+        for (j=0; j <= max_deriv; ++j){
+            tmp = 0;
+            g = start0;
+            for (k=0; k<nin; ++k){
+                tmp += w[k + j*ldw] * ydata[i*set_stride + g*grid_stride];
+                if (++g == len_grid)
+                    g = 0;
+            }
+            out[i*elem_strides_out_set + j*elem_strides_out_deriv] = tmp;
+        }
+    }
+}
+
+static int interpolate_impl(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int len_targets,
+    const int nsets,
+    const int max_deriv,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    const int n_threads,
+    const int apply_variant,
+    const int weights_engine,
+    const FINITEDIFF_REAL period /* > 0: periodic grid */
+)
+{
+    FINITEDIFF_REAL xtgt, cap;
+    const FINITEDIFF_REAL * sg;
     const int nin = nhead + ntail;
+    int tgt_idx, j=0, guess=0, wrapped=0, status=0;
+    bary_stencil_ bary;
     FINITEDIFF_REAL *w, *wp;
     const int elem_strides_w_1 = FINITEDIFF_MIN(len_grid, nin);
+    /* scratch for accumulation across sets, barycentric weights of the current stencil and
+       shifted points of periodic stencils is stored after the weights */
+    const int len_acc = ((ydata_layout == FINITEDIFF_YDATA_GRID_SET) ? nsets*(max_deriv+1) : 0) +
+        ((weights_engine == FINITEDIFF_WEIGHTS_BARYCENTRIC) ? elem_strides_w_1 + max_deriv + 1 : 0) +
+        ((period > 0) ? elem_strides_w_1 : 0);
+    const int off_bary = elem_strides_w_1*(max_deriv+1) +
+        ((ydata_layout == FINITEDIFF_YDATA_GRID_SET) ? nsets*(max_deriv+1) : 0);
+    const int off_sgrid = off_bary + ((weights_engine == FINITEDIFF_WEIGHTS_BARYCENTRIC) ? elem_strides_w_1 + max_deriv + 1 : 0);
+    /* tgt_idx*elem_strides_tgt, set_idx*elem_strides_out_1, deriv_idx*elem_strides_deriv */
+    const int elem_strides_tgt = (out_layout == FINITEDIFF_OUT_TGT_SET_DERIV) ? elem_strides_out_0 : 1;
+    const int elem_strides_deriv = (out_layout == FINITEDIFF_OUT_TGT_SET_DERIV) ? 1 : elem_strides_out_0;
 #ifndef FINITEDIFF_OPENMP
-    const int elem_strides_w_0 = elem_strides_w_1*(max_deriv+1);
+    const int elem_strides_w_0 = elem_strides_w_1*(max_deriv+1) + len_acc;
 #else
-    const int elem_strides_w_0 = FINITEDIFF_ROUND_L1(elem_strides_w_1*(max_deriv+1));
-    char * num_threads_var;
-    num_threads_var = getenv("FINITEDIFF_NUM_THREADS");
-    if (num_threads_var) {
-        n_threads = atoi(num_threads_var);
-        if (!n_threads) {
-            status = FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR;
-            goto exit0;
-        }
-    } else {
-        n_threads = omp_get_num_threads();
-    }
+    const int elem_strides_w_0 = FINITEDIFF_ROUND_L1(elem_strides_w_1*(max_deriv+1) + len_acc);
 #endif
-    if (len_grid < max_deriv + 1){
-        status = FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
-        goto exit0;
-    }
-    if (nin < max_deriv + 1){
-        status = FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS;
-        goto exit0;
-    }
     w = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*elem_strides_w_0*n_threads);
     if (!w) {
         status = FINITEDIFF_STATUS_ERR_BAD_ALLOC;
         goto exit0;
     }
+    bary.start = -len_grid - nin - 2; /* below any (also periodic) stencil start and its neighbours */
+    bary.n_shifts = 0;
+    bary.first = bary.last = bary.cap = 0;
 #ifdef FINITEDIFF_OPENMP
-#pragma omp parallel for private(xtgt, wp) firstprivate(j) schedule(static) num_threads(n_threads)
+#pragma omp parallel for private(xtgt, wp, sg, cap) firstprivate(j, guess, wrapped, bary) schedule(static) num_threads(n_threads)
 #endif
     for (tgt_idx=0; tgt_idx<len_targets; ++tgt_idx) {
         xtgt = xtgts[tgt_idx];
-        j = get_interval_from_guess(grid, len_grid, xtgt, j) - nhead;
-        j = FINITEDIFF_MAX(0, FINITEDIFF_MIN(j, len_grid - nin));
         wp = w + omp_get_thread_num()*elem_strides_w_0;
-        finitediff_calculate_weights(wp, elem_strides_w_1, grid+j, elem_strides_w_1, max_deriv, xtgt);
-        finitediff_apply_fd(out + tgt_idx*elem_strides_out_0, elem_strides_out_1,
-                            wp, elem_strides_w_1, nsets,
-                            max_deriv, elem_strides_w_1, ydata + j, ldy);
+        if (period > 0) {
+            xtgt -= period*floor((xtgt - grid[0])/period);
+            if (xtgt < grid[0] || xtgt >= grid[0] + period)
+                xtgt = grid[0]; /* rounding, e.g. for xtgt == grid[0] +/- period */
+            j = periodic_stencil_start_(grid, len_grid, xtgt, &guess, nhead);
+            wrapped = j < 0 || j + nin > len_grid;
+            if (wrapped) {
+                periodic_stencil_grid_(wp + off_sgrid, grid, len_grid, period, j, nin);
+                sg = wp + off_sgrid;
+            } else {
+                sg = grid + j;
+            }
+        } else {
+            j = stencil_start_(grid, len_grid, xtgt, j, nhead, nin);
+            sg = grid + j;
+        }
+        if (weights_engine == FINITEDIFF_WEIGHTS_BARYCENTRIC) {
+            /* consecutive targets share their stencil or move it by one point */
+            cap = bary_stencil_weights_(&bary, wp + off_bary, sg, elem_strides_w_1, j);
+            finitediff_calculate_weights_barycentric(wp, elem_strides_w_1, sg, elem_strides_w_1, max_deriv, xtgt,
+                                                     wp + off_bary, cap, wp + off_bary + elem_strides_w_1);
+        } else {
+            finitediff_calculate_weights(wp, elem_strides_w_1, sg, elem_strides_w_1, max_deriv, xtgt);
+        }
+        if (wrapped) {
+            apply_fd_wrapped(out + tgt_idx*elem_strides_tgt, elem_strides_out_1, elem_strides_deriv,
+                             wp, elem_strides_w_1, nsets, max_deriv, elem_strides_w_1,
+                             ydata, ydata_layout, ldy, j, len_grid);
+        } else if (ydata_layout == FINITEDIFF_YDATA_GRID_SET) {
+            apply_fd_grid_set(out + tgt_idx*elem_strides_tgt, elem_strides_out_1, elem_strides_deriv,
+                              wp + elem_strides_w_1*(max_deriv+1), wp, elem_strides_w_1, nsets,
+                              max_deriv, elem_strides_w_1, ydata + j*ldy, ldy);
+        } else if (apply_variant == FINITEDIFF_APPLY_BLOCKED) {
+            apply_fd_set_grid_blocked(out + tgt_idx*elem_strides_tgt, elem_strides_out_1, elem_strides_deriv,
+                                      wp, elem_strides_w_1, nsets,
+                                      max_deriv, elem_strides_w_1, ydata + j, ldy);
+        } else if (out_layout == FINITEDIFF_OUT_TGT_SET_DERIV) {
+            finitediff_apply_fd(out + tgt_idx*elem_strides_tgt, elem_strides_out_1,
+                                wp, elem_strides_w_1, nsets,
+                                max_deriv, elem_strides_w_1, ydata + j, ldy);
+        } else {
+            apply_fd_set_grid_strided(out + tgt_idx*elem_strides_tgt, elem_strides_out_1, elem_strides_deriv,
+                                      wp, elem_strides_w_1, nsets,
+                                      max_deriv, elem_strides_w_1, ydata + j, ldy);
+        }
     }
     free(w);
 exit0:
     return status;
 }
-    
+
+/* Tuning table: problem shapes are bucketed, choices apply to all shapes in a bucket */
+#define FINITEDIFF_TUNING_MAX_ENTRIES 256
+#define FINITEDIFF_TUNING_KEY_LEN 6
+#define FINITEDIFF_TUNING_REPEATS 3
+
+struct finitediff_tuning_entry {
+    int key[FINITEDIFF_TUNING_KEY_LEN]; /* nin, lg2(nsets), lg2(len_targets), max_deriv, ydata_layout, out_layout */
+    int n_threads;
+    int apply_variant;
+    int weights_engine;
+};
+
+static struct finitediff_tuning_entry tuning_table[FINITEDIFF_TUNING_MAX_ENTRIES];
+static int tuning_table_len = 0;
+static int tuning_initialized = 0;
+
+/* Guards the three variables above: interpolation may be called concurrently (e.g. from Python without the GIL) */
+#ifdef _WIN32
+static SRWLOCK tuning_lock = SRWLOCK_INIT;
+static void tuning_acquire_(void){ AcquireSRWLockExclusive(&tuning_lock); }
+static void tuning_release_(void){ ReleaseSRWLockExclusive(&tuning_lock); }
+#else
+static pthread_mutex_t tuning_lock = PTHREAD_MUTEX_INITIALIZER;
+static void tuning_acquire_(void){ pthread_mutex_lock(&tuning_lock); }
+static void tuning_release_(void){ pthread_mutex_unlock(&tuning_lock); }
+#endif
+
+static int ilog2_(int n){
+    int b = 0;
+    while (n > 1) {
+        n >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+static void tuning_key(int * const key, const int nin, const int nsets, const int len_targets,
+                       const int max_deriv, const int ydata_layout, const int out_layout){
+    key[0] = nin;
+    key[1] = ilog2_(nsets);
+    key[2] = ilog2_(len_targets);
+    key[3] = max_deriv;
+    key[4] = ydata_layout;
+    key[5] = out_layout;
+}
+
+static struct finitediff_tuning_entry * tuning_lookup(const int * const key){
+    int i, k;
+    for (i=0; i<tuning_table_len; ++i){
+        for (k=0; k<FINITEDIFF_TUNING_KEY_LEN; ++k){
+            if (tuning_table[i].key[k] != key[k])
+                break;
+        }
+        if (k == FINITEDIFF_TUNING_KEY_LEN)
+            return tuning_table + i;
+    }
+    return NULL;
+}
+
+static void tuning_insert(const int * const key, const int n_threads, const int apply_variant,
+                          const int weights_engine){
+    int k;
+    struct finitediff_tuning_entry * entry = tuning_lookup(key);
+    if (!entry) {
+        if (tuning_table_len == FINITEDIFF_TUNING_MAX_ENTRIES)
+            return;
+        entry = tuning_table + tuning_table_len++;
+        for (k=0; k<FINITEDIFF_TUNING_KEY_LEN; ++k)
+            entry->key[k] = key[k];
+    }
+    entry->n_threads = n_threads;
+    entry->apply_variant = apply_variant;
+    entry->weights_engine = weights_engine;
+}
+
+static int tuning_load_locked_(const char * const path);
+
+/* Caller holds tuning_lock */
+static void tuning_init_locked_(void){
+    const char * path;
+    if (tuning_initialized)
+        return;
+    tuning_initialized = 1;
+    path = getenv("FINITEDIFF_TUNING_FILE");
+    if (path)
+        tuning_load_locked_(path); /* a missing file is not an error here */
+}
+
+/* Copies the tuned choices for ``key`` (returns 0 if the shape is not in the table) */
+static int tuning_choices_(const int * const key, int * const n_threads, int * const apply_variant,
+                           int * const weights_engine){
+    const struct finitediff_tuning_entry * entry;
+    tuning_acquire_();
+    tuning_init_locked_();
+    entry = tuning_lookup(key);
+    if (entry) {
+        *n_threads = entry->n_threads;
+        *apply_variant = entry->apply_variant;
+        *weights_engine = entry->weights_engine;
+    }
+    tuning_release_();
+    return entry != NULL;
+}
+
+static double wall_time_(void){
+#ifdef FINITEDIFF_OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+/* Caller holds tuning_lock */
+static int tuning_load_locked_(const char * const path)
+{
+    char line[256];
+    int key[FINITEDIFF_TUNING_KEY_LEN], n_threads, apply_variant, weights_engine, nread;
+    FILE * fh = fopen(path, "r");
+    if (!fh)
+        return FINITEDIFF_STATUS_ERR_IO;
+    while (fgets(line, sizeof(line), fh)) {
+        if (line[0] == '#')
+            continue;
+        weights_engine = FINITEDIFF_WEIGHTS_FORNBERG;
+        nread = sscanf(line, "%d %d %d %d %d %d %d %d %d", key, key+1, key+2, key+3, key+4, key+5,
+                       &n_threads, &apply_variant, &weights_engine);
+        if (nread < 8 || n_threads <= 0 ||
+            (apply_variant != FINITEDIFF_APPLY_NAIVE && apply_variant != FINITEDIFF_APPLY_BLOCKED) ||
+            (weights_engine != FINITEDIFF_WEIGHTS_FORNBERG && weights_engine != FINITEDIFF_WEIGHTS_BARYCENTRIC))
+            continue; /* malformed or corrupt line */
+        tuning_insert(key, n_threads, apply_variant, weights_engine);
+    }
+    fclose(fh);
+    tuning_initialized = 1;
+    return FINITEDIFF_STATUS_SUCCESS;
+}
+
+int finitediff_tuning_load(const char * const path)
+{
+    int status;
+    tuning_acquire_();
+    status = tuning_load_locked_(path);
+    tuning_release_();
+    return status;
+}
+
+int finitediff_tuning_save(const char * const path)
+{
+    int i, status = FINITEDIFF_STATUS_SUCCESS;
+    const int * key;
+    FILE * fh = fopen(path, "w");
+    if (!fh)
+        return FINITEDIFF_STATUS_ERR_IO;
+    tuning_acquire_();
+    fprintf(fh, "# finitediff tuning v2: nin lg2_nsets lg2_len_targets max_deriv ydata_layout out_layout"
+            " n_threads apply_variant weights_engine\n");
+    for (i=0; i<tuning_table_len; ++i){
+        key = tuning_table[i].key;
+        fprintf(fh, "%d %d %d %d %d %d %d %d %d\n", key[0], key[1], key[2], key[3], key[4], key[5],
+                tuning_table[i].n_threads, tuning_table[i].apply_variant, tuning_table[i].weights_engine);
+    }
+    tuning_release_();
+    if (fclose(fh))
+        status = FINITEDIFF_STATUS_ERR_IO;
+    return status;
+}
+
+void finitediff_tuning_clear(void)
+{
+    tuning_acquire_();
+    tuning_table_len = 0;
+    tuning_initialized = 1;
+    tuning_release_();
+}
+
+static int check_interpolate_args_(
+    const int max_deriv, const int out_layout, const int nin, const int len_grid, const int ydata_layout)
+{
+    if ((out_layout != FINITEDIFF_OUT_TGT_SET_DERIV && out_layout != FINITEDIFF_OUT_DERIV_SET_TGT) ||
+        (ydata_layout != FINITEDIFF_YDATA_SET_GRID && ydata_layout != FINITEDIFF_YDATA_GRID_SET)) {
+        return FINITEDIFF_STATUS_ERR_UNKNOWN_LAYOUT;
+    }
+    if (len_grid < max_deriv + 1){
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
+    }
+    if (nin < max_deriv + 1){
+        return FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS;
+    }
+    return FINITEDIFF_STATUS_SUCCESS;
+}
+
+/* Weights engine for stencils of ``nin`` points requested through FINITEDIFF_WEIGHTS_ENGINE
+   (-1 if unset, -2 if illegal) */
+static int env_weights_engine_(const int nin){
+    const char * engine_var = getenv("FINITEDIFF_WEIGHTS_ENGINE");
+    if (!engine_var)
+        return -1;
+    if (!strcmp(engine_var, "fornberg"))
+        return FINITEDIFF_WEIGHTS_FORNBERG;
+    if (!strcmp(engine_var, "barycentric"))
+        return FINITEDIFF_WEIGHTS_BARYCENTRIC;
+    if (!strcmp(engine_var, "auto"))
+        return (nin < FINITEDIFF_BARYCENTRIC_MIN_STENCIL) ? FINITEDIFF_WEIGHTS_FORNBERG : FINITEDIFF_WEIGHTS_BARYCENTRIC;
+    return -2;
+}
+
+/* Number of threads requested through FINITEDIFF_NUM_THREADS (0 if unset, -1 if illegal) */
+static int env_num_threads_(void){
+#ifdef FINITEDIFF_OPENMP
+    int n_threads;
+    const char * num_threads_var = getenv("FINITEDIFF_NUM_THREADS");
+    if (num_threads_var) {
+        n_threads = atoi(num_threads_var);
+        return n_threads ? n_threads : -1;
+    }
+#endif
+    return 0;
+}
+
+int finitediff_autotune_interpolate(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int len_targets,
+    const int nsets,
+    const int max_deriv,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts
+)
+{
+    int key[FINITEDIFF_TUNING_KEY_LEN];
+    int ti, vi, ei, rep, status;
+    int best_threads = 1, best_variant = FINITEDIFF_APPLY_NAIVE, best_engine = FINITEDIFF_WEIGHTS_FORNBERG;
+    double t0, elapsed, best_time = -1;
+    const char * path;
+    int thread_candidates[2], n_thread_candidates;
+    const int n_variants = (ydata_layout == FINITEDIFF_YDATA_GRID_SET) ? 1 : 2;
+    thread_candidates[0] = 1;
+    thread_candidates[1] = omp_get_max_threads();
+    n_thread_candidates = (thread_candidates[1] > 1) ? 2 : 1;
+    status = check_interpolate_args_(max_deriv, out_layout, nhead + ntail, len_grid, ydata_layout);
+    if (status)
+        return status;
+    tuning_acquire_();
+    tuning_init_locked_(); /* before inserting, entries read later would overwrite the tuned choice */
+    tuning_release_();
+    for (ti=0; ti<n_thread_candidates; ++ti){
+        for (vi=0; vi<n_variants; ++vi){
+            for (ei=0; ei<2; ++ei){
+                for (rep=0; rep<FINITEDIFF_TUNING_REPEATS; ++rep){
+                    t0 = wall_time_();
+                    status = interpolate_impl(out, len_targets, nsets, max_deriv, out_layout, elem_strides_out_0,
+                                              elem_strides_out_1, ntail, nhead, grid, len_grid, ydata, ydata_layout,
+                                              ldy, xtgts, thread_candidates[ti], vi, ei, 0);
+                    elapsed = wall_time_() - t0;
+                    if (status)
+                        return status;
+                    if (best_time < 0 || elapsed < best_time) {
+                        best_time = elapsed;
+                        best_threads = thread_candidates[ti];
+                        best_variant = vi;
+                        best_engine = ei;
+                    }
+                }
+            }
+        }
+    }
+    tuning_key(key, FINITEDIFF_MIN(len_grid, nhead + ntail), nsets, len_targets, max_deriv, ydata_layout, out_layout);
+    tuning_acquire_();
+    tuning_insert(key, best_threads, best_variant, best_engine);
+    tuning_release_();
+    path = getenv("FINITEDIFF_TUNING_FILE");
+    if (path)
+        status = finitediff_tuning_save(path);
+    return status;
+}
+
+int finitediff_interpolate_by_finite_diff_layout(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int len_targets,
+    const int nsets,
+    const int max_deriv,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts
+)
+{
+    int key[FINITEDIFF_TUNING_KEY_LEN];
+    int status, n_threads = 1, apply_variant = FINITEDIFF_APPLY_NAIVE;
+    int weights_engine = FINITEDIFF_WEIGHTS_FORNBERG;
+    const char * autotune_var;
+    const int env_threads = env_num_threads_();
+    const int env_engine = env_weights_engine_(FINITEDIFF_MIN(len_grid, nhead + ntail));
+    if (env_threads < 0 || env_engine == -2)
+        return FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR;
+    status = check_interpolate_args_(max_deriv, out_layout, nhead + ntail, len_grid, ydata_layout);
+    if (status)
+        return status;
+    tuning_key(key, FINITEDIFF_MIN(len_grid, nhead + ntail), nsets, len_targets, max_deriv, ydata_layout, out_layout);
+    if (!tuning_choices_(key, &n_threads, &apply_variant, &weights_engine)) {
+        autotune_var = getenv("FINITEDIFF_AUTOTUNE");
+        if (autotune_var && atoi(autotune_var) && !env_threads && env_engine < 0) {
+            return finitediff_autotune_interpolate(
+                out, len_targets, nsets, max_deriv, out_layout, elem_strides_out_0, elem_strides_out_1,
+                ntail, nhead, grid, len_grid, ydata, ydata_layout, ldy, xtgts);
+        }
+    }
+    if (env_threads)
+        n_threads = env_threads;
+    if (env_engine >= 0)
+        weights_engine = env_engine;
+    return interpolate_impl(out, len_targets, nsets, max_deriv, out_layout, elem_strides_out_0, elem_strides_out_1,
+                            ntail, nhead, grid, len_grid, ydata, ydata_layout, ldy, xtgts, n_threads, apply_variant,
+                            weights_engine, 0);
+}
+
+int finitediff_interpolate_periodic(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int len_targets,
+    const int nsets,
+    const int max_deriv,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL period,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts
+)
+{
+    int key[FINITEDIFF_TUNING_KEY_LEN];
+    int status, n_threads = 1, apply_variant = FINITEDIFF_APPLY_NAIVE;
+    int weights_engine = FINITEDIFF_WEIGHTS_FORNBERG;
+    const int env_threads = env_num_threads_();
+    const int env_engine = env_weights_engine_(nhead + ntail);
+    if (env_threads < 0 || env_engine == -2)
+        return FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR;
+    status = check_interpolate_args_(max_deriv, out_layout, nhead + ntail, len_grid, ydata_layout);
+    if (status)
+        return status;
+    if (len_grid < nhead + ntail) /* a point may not appear twice in a stencil */
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
+    if (!(period > grid[len_grid - 1] - grid[0]))
+        return FINITEDIFF_STATUS_ERR_BAD_PERIOD;
+    /* tuned choices of the non-periodic problem of the same shape (never autotuned from here) */
+    tuning_key(key, nhead + ntail, nsets, len_targets, max_deriv, ydata_layout, out_layout);
+    tuning_choices_(key, &n_threads, &apply_variant, &weights_engine);
+    if (env_threads)
+        n_threads = env_threads;
+    if (env_engine >= 0)
+        weights_engine = env_engine;
+    return interpolate_impl(out, len_targets, nsets, max_deriv, out_layout, elem_strides_out_0, elem_strides_out_1,
+                            ntail, nhead, grid, len_grid, ydata, ydata_layout, ldy, xtgts, n_threads, apply_variant,
+                            weights_engine, period);
+}
+
+static const char weights_magic[8] = {'F', 'D', 'W', 'E', 'I', 'G', 'H', 'T'};
+#define FINITEDIFF_WEIGHTS_HEADER_NBYTES 64
+#define FINITEDIFF_WEIGHTS_ENDIAN_TAG 0x01020304
+enum { weights_hdr_endian=0, weights_hdr_version, weights_hdr_real_size, weights_hdr_len_targets,
+       weights_hdr_max_deriv, weights_hdr_stencil_len, weights_hdr_len_grid, weights_hdr_nfields=14 };
+
+static size_t align64_(const size_t n){
+    return (n + 63u) & ~(size_t)63u;
+}
+
+static void weights_offsets_(size_t * const off_starts, size_t * const off_weights, const int len_targets){
+    *off_starts = FINITEDIFF_WEIGHTS_HEADER_NBYTES + align64_(sizeof(FINITEDIFF_REAL)*len_targets);
+    *off_weights = *off_starts + align64_(sizeof(int)*len_targets);
+}
+
+size_t finitediff_weights_nbytes(const int len_targets, const int max_deriv, const int stencil_len)
+{
+    size_t off_starts, off_weights;
+    weights_offsets_(&off_starts, &off_weights, len_targets);
+    return off_weights + sizeof(FINITEDIFF_REAL)*len_targets*(max_deriv+1)*stencil_len;
+}
+
+int finitediff_weights_build(
+    void * const buf,
+    const size_t nbytes,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    const int len_targets,
+    const int max_deriv,
+    const int ntail,
+    const int nhead
+)
+{
+    int tgt_idx, j=0;
+    int hdr[weights_hdr_nfields];
+    size_t off_starts, off_weights;
+    char * const cbuf = (char *)buf;
+    FINITEDIFF_REAL * xt, * w;
+    int * starts;
+    const int nin = FINITEDIFF_MIN(len_grid, nhead + ntail);
+    if (len_grid < max_deriv + 1)
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
+    if (nhead + ntail < max_deriv + 1)
+        return FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS;
+    if (nbytes < finitediff_weights_nbytes(len_targets, max_deriv, nin))
+        return FINITEDIFF_STATUS_ERR_WRONG_LEADING_DIMENSION;
+    memset(hdr, 0, sizeof(hdr));
+    hdr[weights_hdr_endian] = FINITEDIFF_WEIGHTS_ENDIAN_TAG;
+    hdr[weights_hdr_version] = FINITEDIFF_WEIGHTS_FORMAT_VERSION;
+    hdr[weights_hdr_real_size] = sizeof(FINITEDIFF_REAL);
+    hdr[weights_hdr_len_targets] = len_targets;
+    hdr[weights_hdr_max_deriv] = max_deriv;
+    hdr[weights_hdr_stencil_len] = nin;
+    hdr[weights_hdr_len_grid] = len_grid;
+    memset(cbuf, 0, FINITEDIFF_WEIGHTS_HEADER_NBYTES);
+    memcpy(cbuf, weights_magic, sizeof(weights_magic));
+    memcpy(cbuf + sizeof(weights_magic), hdr, sizeof(hdr));
+    weights_offsets_(&off_starts, &off_weights, len_targets);
+    xt = (FINITEDIFF_REAL *)(cbuf + FINITEDIFF_WEIGHTS_HEADER_NBYTES);
+    starts = (int *)(cbuf + off_starts);
+    w = (FINITEDIFF_REAL *)(cbuf + off_weights);
+    memset(cbuf + FINITEDIFF_WEIGHTS_HEADER_NBYTES, 0, off_weights - FINITEDIFF_WEIGHTS_HEADER_NBYTES);
+    for (tgt_idx=0; tgt_idx<len_targets; ++tgt_idx) {
+        xt[tgt_idx] = xtgts[tgt_idx];
+        j = stencil_start_(grid, len_grid, xtgts[tgt_idx], j, nhead, nhead + ntail);
+        starts[tgt_idx] = j;
+        finitediff_calculate_weights(w + tgt_idx*(max_deriv+1)*nin, nin, grid + j, nin, max_deriv, xtgts[tgt_idx]);
+    }
+    return FINITEDIFF_STATUS_SUCCESS;
+}
+
+int finitediff_weights_write(
+    const char * const path,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    const int len_targets,
+    const int max_deriv,
+    const int ntail,
+    const int nhead
+)
+{
+    int status;
+    FILE * fh;
+    const size_t nbytes = finitediff_weights_nbytes(len_targets, max_deriv, FINITEDIFF_MIN(len_grid, nhead + ntail));
+    void * buf = malloc(nbytes);
+    if (!buf) {
+        status = FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+        goto exit0;
+    }
+    status = finitediff_weights_build(buf, nbytes, grid, len_grid, xtgts, len_targets, max_deriv, ntail, nhead);
+    if (status)
+        goto exit1;
+    fh = fopen(path, "wb");
+    if (!fh) {
+        status = FINITEDIFF_STATUS_ERR_IO;
+        goto exit1;
+    }
+    if (fwrite(buf, 1, nbytes, fh) != nbytes)
+        status = FINITEDIFF_STATUS_ERR_IO;
+    if (fclose(fh))
+        status = FINITEDIFF_STATUS_ERR_IO;
+exit1:
+    free(buf);
+exit0:
+    return status;
+}
+
+int finitediff_weights_view_init(
+    finitediff_weights_view * const view,
+    const void * const data,
+    const size_t nbytes
+)
+{
+    int hdr[weights_hdr_nfields], k;
+    size_t off_starts, off_weights;
+    const char * const cdata = (const char *)data;
+    const int * starts;
+    if (nbytes < FINITEDIFF_WEIGHTS_HEADER_NBYTES || memcmp(cdata, weights_magic, sizeof(weights_magic)))
+        return FINITEDIFF_STATUS_ERR_BAD_FORMAT;
+    memcpy(hdr, cdata + sizeof(weights_magic), sizeof(hdr));
+    if (hdr[weights_hdr_endian] != FINITEDIFF_WEIGHTS_ENDIAN_TAG ||
+        hdr[weights_hdr_version] != FINITEDIFF_WEIGHTS_FORMAT_VERSION ||
+        hdr[weights_hdr_real_size] != (int)sizeof(FINITEDIFF_REAL) ||
+        hdr[weights_hdr_len_targets] < 0 || hdr[weights_hdr_max_deriv] < 0 ||
+        hdr[weights_hdr_stencil_len] < hdr[weights_hdr_max_deriv] + 1 ||
+        hdr[weights_hdr_len_grid] < hdr[weights_hdr_stencil_len] ||
+        nbytes < finitediff_weights_nbytes(hdr[weights_hdr_len_targets], hdr[weights_hdr_max_deriv],
+                                           hdr[weights_hdr_stencil_len]))
+        return FINITEDIFF_STATUS_ERR_BAD_FORMAT;
+    weights_offsets_(&off_starts, &off_weights, hdr[weights_hdr_len_targets]);
+    starts = (const int *)(cdata + off_starts);
+    for (k=0; k<hdr[weights_hdr_len_targets]; ++k){
+        /* stencils must lie within the grid (finitediff_apply_weights_view does not check) */
+        if (starts[k] < 0 || starts[k] > hdr[weights_hdr_len_grid] - hdr[weights_hdr_stencil_len])
+            return FINITEDIFF_STATUS_ERR_BAD_FORMAT;
+    }
+    view->xtgts = (const FINITEDIFF_REAL *)(cdata + FINITEDIFF_WEIGHTS_HEADER_NBYTES);
+    view->starts = starts;
+    view->weights = (const FINITEDIFF_REAL *)(cdata + off_weights);
+    view->len_targets = hdr[weights_hdr_len_targets];
+    view->max_deriv = hdr[weights_hdr_max_deriv];
+    view->stencil_len = hdr[weights_hdr_stencil_len];
+    view->len_grid = hdr[weights_hdr_len_grid];
+    return FINITEDIFF_STATUS_SUCCESS;
+}
+
+int finitediff_weights_mmap(
+    finitediff_weights_view * const view,
+    const void ** const data,
+    size_t * const nbytes,
+    const char * const path
+)
+{
+#ifdef FINITEDIFF_HAVE_MMAP
+    int status, fd;
+    struct stat st;
+    void * addr;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FINITEDIFF_STATUS_ERR_IO;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return FINITEDIFF_STATUS_ERR_IO;
+    }
+    if (st.st_size < FINITEDIFF_WEIGHTS_HEADER_NBYTES) {
+        close(fd);
+        return FINITEDIFF_STATUS_ERR_BAD_FORMAT;
+    }
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return FINITEDIFF_STATUS_ERR_IO;
+    status = finitediff_weights_view_init(view, addr, (size_t)st.st_size);
+    if (status) {
+        munmap(addr, (size_t)st.st_size);
+        return status;
+    }
+    *data = addr;
+    *nbytes = (size_t)st.st_size;
+    return FINITEDIFF_STATUS_SUCCESS;
+#else
+    (void)view; (void)data; (void)nbytes; (void)path;
+    return FINITEDIFF_STATUS_ERR_IO;
+#endif
+}
+
+int finitediff_weights_munmap(const void * const data, const size_t nbytes)
+{
+#ifdef FINITEDIFF_HAVE_MMAP
+    return munmap((void *)data, nbytes) ? FINITEDIFF_STATUS_ERR_IO : FINITEDIFF_STATUS_SUCCESS;
+#else
+    (void)data; (void)nbytes;
+    return FINITEDIFF_STATUS_ERR_IO;
+#endif
+}
+
+int finitediff_apply_weights_view(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int nsets,
+    const int out_layout,
+    const int elem_strides_out_0,
+    const int elem_strides_out_1,
+    const finitediff_weights_view * const view,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ydata_layout,
+    const int ldy
+)
+{
+    int tgt_idx, status = FINITEDIFF_STATUS_SUCCESS;
+    FINITEDIFF_REAL * acc = NULL;
+    const FINITEDIFF_REAL * wp;
+    const int nin = view->stencil_len, max_deriv = view->max_deriv;
+    const int elem_strides_tgt = (out_layout == FINITEDIFF_OUT_TGT_SET_DERIV) ? elem_strides_out_0 : 1;
+    const int elem_strides_deriv = (out_layout == FINITEDIFF_OUT_TGT_SET_DERIV) ? 1 : elem_strides_out_0;
+    status = check_interpolate_args_(max_deriv, out_layout, nin, view->len_grid, ydata_layout);
+    if (status)
+        return status;
+    if (ydata_layout == FINITEDIFF_YDATA_GRID_SET) {
+        acc = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*nsets*(max_deriv+1));
+        if (!acc)
+            return FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+    }
+    for (tgt_idx=0; tgt_idx<view->len_targets; ++tgt_idx) {
+        wp = view->weights + tgt_idx*(max_deriv+1)*nin;
+        if (ydata_layout == FINITEDIFF_YDATA_GRID_SET) {
+            apply_fd_grid_set(out + tgt_idx*elem_strides_tgt, elem_strides_out_1, elem_strides_deriv, acc,
+                              wp, nin, nsets, max_deriv, nin, ydata + view->starts[tgt_idx]*ldy, ldy);
+        } else {
+            apply_fd_set_grid_strided(out + tgt_idx*elem_strides_tgt, elem_strides_out_1, elem_strides_deriv,
+                                      wp, nin, nsets, max_deriv, nin, ydata + view->starts[tgt_idx], ldy);
+        }
+    }
+    free(acc);
+    return status;
+}
+
+struct finitediff_plan {
+    int len_grid;
+    int len_targets;
+    int max_deriv;
+    int ntail;
+    int nhead;
+    int stencil_len;
+    int n_threads;
+    int weights_engine;
+    FINITEDIFF_REAL rtol;
+    FINITEDIFF_REAL * xtgts;   /* [len_targets] */
+    FINITEDIFF_REAL * wtgts;   /* [len_targets] targets the weights were computed for */
+    int * starts;              /* [len_targets] */
+    FINITEDIFF_REAL * sgrid;   /* [len_targets][stencil_len]: grid points the weights were computed for */
+    FINITEDIFF_REAL * weights; /* [len_targets][max_deriv+1][stencil_len] (as in finitediff_weights_view) */
+    int * stale;               /* [len_targets] indices of targets to refresh */
+    FINITEDIFF_REAL * scratch; /* [n_threads][stencil_len + max_deriv + 1] */
+};
+
+/* Recomputes stencil & weights of target ``tgt_idx`` of ``plan`` for ``grid`` (``bary`` describes the
+   barycentric weights in ``scratch``) */
+static void plan_refresh_(finitediff_plan * const plan, const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+                          const int tgt_idx, const int start, FINITEDIFF_REAL * const FINITEDIFF_RESTRICT scratch,
+                          bary_stencil_ * const bary)
+{
+    int i;
+    FINITEDIFF_REAL cap;
+    const int nin = plan->stencil_len;
+    FINITEDIFF_REAL * const w = plan->weights + tgt_idx*(plan->max_deriv+1)*nin;
+    plan->starts[tgt_idx] = start;
+    plan->wtgts[tgt_idx] = plan->xtgts[tgt_idx];
+    for (i=0; i<nin; ++i){
+        plan->sgrid[tgt_idx*nin + i] = grid[start + i];
+    }
+    if (plan->weights_engine == FINITEDIFF_WEIGHTS_FORNBERG) {
+        finitediff_calculate_weights(w, nin, grid + start, nin, plan->max_deriv, plan->xtgts[tgt_idx]);
+    } else {
+        cap = bary_stencil_weights_(bary, scratch, grid + start, nin, start);
+        finitediff_calculate_weights_barycentric(w, nin, grid + start, nin, plan->max_deriv, plan->xtgts[tgt_idx],
+                                                 scratch, cap, scratch + nin);
+    }
+}
+
+void finitediff_plan_destroy(finitediff_plan * const plan)
+{
+    if (!plan)
+        return;
+    free(plan->xtgts);
+    free(plan->wtgts);
+    free(plan->starts);
+    free(plan->sgrid);
+    free(plan->weights);
+    free(plan->stale);
+    free(plan->scratch);
+    free(plan);
+}
+
+int finitediff_plan_create(
+    finitediff_plan ** const plan_out,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    const int len_targets,
+    const int max_deriv,
+    const int ntail,
+    const int nhead,
+    const FINITEDIFF_REAL rtol
+)
+{
+    int status, n_refreshed, nin, ntgts;
+    finitediff_plan * plan;
+    const int env_threads = env_num_threads_();
+    const int env_engine = env_weights_engine_(FINITEDIFF_MIN(len_grid, nhead + ntail));
+    *plan_out = NULL;
+    if (env_threads < 0 || env_engine == -2)
+        return FINITEDIFF_STATUS_ERR_ILLEGAL_ENV_VAR;
+    if (len_grid < max_deriv + 1)
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
+    if (nhead + ntail < max_deriv + 1)
+        return FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS;
+    plan = (finitediff_plan *)malloc(sizeof(finitediff_plan));
+    if (!plan)
+        return FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+    nin = FINITEDIFF_MIN(len_grid, nhead + ntail);
+    plan->len_grid = len_grid;
+    plan->len_targets = len_targets;
+    plan->max_deriv = max_deriv;
+    plan->ntail = ntail;
+    plan->nhead = nhead;
+    plan->stencil_len = nin;
+    plan->n_threads = env_threads ? env_threads : omp_get_max_threads();
+    plan->weights_engine = (env_engine < 0) ? FINITEDIFF_WEIGHTS_FORNBERG : env_engine;
+    plan->rtol = rtol;
+    ntgts = FINITEDIFF_MAX(len_targets, 1); /* avoid malloc(0) */
+    plan->xtgts = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*ntgts);
+    plan->wtgts = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*ntgts);
+    plan->starts = (int *)malloc(sizeof(int)*ntgts);
+    plan->sgrid = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*ntgts*nin);
+    plan->weights = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*ntgts*nin*(max_deriv+1));
+    plan->stale = (int *)malloc(sizeof(int)*ntgts);
+    plan->scratch = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*plan->n_threads*(nin + max_deriv + 1));
+    if (!plan->xtgts || !plan->wtgts || !plan->starts || !plan->sgrid || !plan->weights || !plan->stale || !plan->scratch) {
+        finitediff_plan_destroy(plan);
+        return FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+    }
+    memcpy(plan->xtgts, xtgts, sizeof(FINITEDIFF_REAL)*len_targets);
+    /* no stencil is valid yet: every target is refreshed */
+    memset(plan->sgrid, 0, sizeof(FINITEDIFF_REAL)*len_targets*nin);
+    for (ntgts=0; ntgts<len_targets; ++ntgts)
+        plan->starts[ntgts] = -1;
+    status = finitediff_plan_update(plan, grid, NULL, &n_refreshed);
+    if (status) {
+        finitediff_plan_destroy(plan);
+        return status;
+    }
+    *plan_out = plan;
+    return FINITEDIFF_STATUS_SUCCESS;
+}
+
+int finitediff_plan_update(
+    finitediff_plan * const plan,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT xtgts,
+    int * const n_refreshed
+)
+{
+    int tgt_idx, i, j=0, idx, n_stale=0, stale;
+    FINITEDIFF_REAL tol;
+    const int nin = plan->stencil_len;
+    const FINITEDIFF_REAL * sg;
+    bary_stencil_ bary;
+    /* 1. find the stencils which moved (beyond rtol relative to their width) or shifted window */
+    for (tgt_idx=0; tgt_idx<plan->len_targets; ++tgt_idx) {
+        sg = plan->sgrid + tgt_idx*nin;
+        tol = plan->rtol*(sg[nin-1] - sg[0]);
+        if (tol < 0)
+            tol = -tol;
+        stale = plan->starts[tgt_idx] < 0;
+        if (xtgts) {
+            /* drift is measured from the target of the weights (not the previous call) so that
+               many small steps add up */
+            stale = stale || (FINITEDIFF_MAX(xtgts[tgt_idx] - plan->wtgts[tgt_idx],
+                                             plan->wtgts[tgt_idx] - xtgts[tgt_idx]) > tol);
+            plan->xtgts[tgt_idx] = xtgts[tgt_idx];
+        }
+        j = stencil_start_(grid, plan->len_grid, plan->xtgts[tgt_idx], j, plan->nhead, plan->nhead + plan->ntail);
+        stale = stale || j != plan->starts[tgt_idx];
+        for (i=0; i<nin && !stale; ++i){
+            stale = FINITEDIFF_MAX(grid[j + i] - sg[i], sg[i] - grid[j + i]) > tol;
+        }
+        if (stale) {
+            plan->stale[n_stale++] = tgt_idx;
+            plan->starts[tgt_idx] = j; /* the start is final, weights follow below */
+        }
+    }
+    /* 2. recompute their weights (stale targets in order: barycentric weights are mostly shifted) */
+    bary.start = -2; /* none, starts are >= 0 */
+    bary.n_shifts = 0;
+    bary.first = bary.last = bary.cap = 0;
+#ifdef FINITEDIFF_OPENMP
+#pragma omp parallel for private(tgt_idx) firstprivate(bary) schedule(dynamic, 16) num_threads(plan->n_threads)
+#endif
+    for (idx=0; idx<n_stale; ++idx) {
+        tgt_idx = plan->stale[idx];
+        plan_refresh_(plan, grid, tgt_idx, plan->starts[tgt_idx],
+                      plan->scratch + omp_get_thread_num()*(nin + plan->max_deriv + 1), &bary);
+    }
+    *n_refreshed = n_stale;
+    return FINITEDIFF_STATUS_SUCCESS;
+}
+
+void finitediff_plan_view(const finitediff_plan * const plan, finitediff_weights_view * const view)
+{
+    view->xtgts = plan->xtgts;
+    view->starts = plan->starts;
+    view->weights = plan->weights;
+    view->len_targets = plan->len_targets;
+    view->max_deriv = plan->max_deriv;
+    view->stencil_len = plan->stencil_len;
+    view->len_grid = plan->len_grid;
+}
+
+/* Number of nodes per block of the uniform sweep (the block of ``out`` stays in L1 across the stencil) */
+#define FINITEDIFF_SWEEP_BLOCK 256
+
+/* Last index ``e`` such that grid[start..e] is uniformly spaced (within FINITEDIFF_UNIFORM_RTOL) */
+static int uniform_run_end_(
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const int start
+)
+{
+    int e;
+    FINITEDIFF_REAL h, tol;
+    if (start + 1 >= len_grid)
+        return start;
+    h = grid[start + 1] - grid[start];
+    tol = FINITEDIFF_UNIFORM_RTOL*FINITEDIFF_MAX(h, -h);
+    for (e = start + 1; e + 1 < len_grid; ++e){
+        if (FINITEDIFF_MAX(grid[e + 1] - grid[e] - h, h - grid[e + 1] + grid[e]) > tol)
+            break;
+    }
+    return e;
+}
+
+FINITEDIFF_TARGET_CLONES
+static void sweep_uniform_(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int ld_out_set,
+    const int ld_out_deriv,
+    const int nsets,
+    const int max_deriv,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT w, /* w[k + deriv_idx*npoints] */
+    const int npoints,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata, /* first point of the stencil of the first node */
+    const int ldy,
+    const int nnodes
+)
+{
+    /* streaming convolution: unit stride along the nodes in the innermost loop */
+    int i, j, k, b, n, nb;
+    FINITEDIFF_REAL wk;
+    FINITEDIFF_REAL * FINITEDIFF_RESTRICT o;
+    const FINITEDIFF_REAL * FINITEDIFF_RESTRICT y;
+    for (b = 0; b < nnodes; b += FINITEDIFF_SWEEP_BLOCK){
+        nb = FINITEDIFF_MIN(FINITEDIFF_SWEEP_BLOCK, nnodes - b);
+        for (i = 0; i < nsets; ++i){
+            for (j = 0; j <= max_deriv; ++j){
+                o = out + i*ld_out_set + j*ld_out_deriv + b;
+                y = ydata + i*ldy + b;
+                wk = w[j*npoints];
+                for (n = 0; n < nb; ++n)
+                    o[n] = wk*y[n];
+                for (k = 1; k < npoints; ++k){
+                    wk = w[k + j*npoints];
+                    for (n = 0; n < nb; ++n)
+                        o[n] += wk*y[k + n];
+                }
+            }
+        }
+    }
+}
+
+int finitediff_differentiate_on_grid(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    const int ld_out_set,
+    const int ld_out_deriv,
+    const int nsets,
+    const int max_deriv,
+    const int npoints,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT grid,
+    const int len_grid,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT ydata,
+    const int ldy
+)
+{
+    int status = FINITEDIFF_STATUS_SUCCESS, node, start, run_end, last, i, j, k;
+    FINITEDIFF_REAL h, scale, tmp, *w, *offsets;
+    const int nin = FINITEDIFF_MIN(len_grid, npoints);
+    const int nbefore = (nin - 1)/2;
+    if (len_grid < max_deriv + 1)
+        return FINITEDIFF_STATUS_ERR_TOO_SMALL_GRID;
+    if (npoints < max_deriv + 1)
+        return FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS;
+    w = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*(nin*(max_deriv+1) + nin));
+    if (!w) {
+        status = FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+        goto exit0;
+    }
+    offsets = w + nin*(max_deriv+1);
+    for (node = 0; node < len_grid;){
+        start = FINITEDIFF_MAX(0, FINITEDIFF_MIN(node - nbefore, len_grid - nin));
+        if (start == node - nbefore && nin > 1) {
+            /* nodes whose (centred) stencils lie within one uniformly spaced run share the weights */
+            run_end = uniform_run_end_(grid, len_grid, start);
+            last = FINITEDIFF_MIN(run_end, len_grid - 1) - (nin - 1 - nbefore);
+            if (last >= node) {
+                h = (grid[run_end] - grid[start])/(run_end - start);
+                for (k = 0; k < nin; ++k)
+                    offsets[k] = k - nbefore;
+                finitediff_calculate_weights(w, nin, offsets, nin, max_deriv, 0);
+                scale = 1;
+                for (j = 1; j <= max_deriv; ++j){
+                    scale /= h;
+                    for (k = 0; k < nin; ++k)
+                        w[k + j*nin] *= scale;
+                }
+                sweep_uniform_(out + node, ld_out_set, ld_out_deriv, nsets, max_deriv, w, nin,
+                               ydata + start, ldy, last - node + 1);
+                node = last + 1;
+                continue;
+            }
+        }
+        /* one-sided (boundary) or non-uniform stencil */
+        finitediff_calculate_weights(w, nin, grid + start, nin, max_deriv, grid[node]);
+        for (i = 0; i < nsets; ++i){
+            for (j = 0; j <= max_deriv; ++j){
+                tmp = 0;
+                for (k = 0; k < nin; ++k)
+                    tmp += w[k + j*nin]*ydata[i*ldy + start + k];
+                out[i*ld_out_set + j*ld_out_deriv + node] = tmp;
+            }
+        }
+        ++node;
+    }
+    free(w);
+exit0:
+    return status;
+}
+
+int finitediff_differentiate_function(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT out,
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT err,
+    int * const n_evals,
+    finitediff_batch_callback cb,
+    void * const user_data,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT x,
+    const int len_x,
+    const int deriv,
+    const int npoints,
+    const FINITEDIFF_REAL h0,
+    const FINITEDIFF_REAL rtol,
+    const FINITEDIFF_REAL atol,
+    const int max_rounds
+)
+{
+    int status = FINITEDIFF_STATUS_SUCCESS, round, a, i, j, k, nb, n_active, n_next, done, order, nev = 0;
+    int * active;
+    FINITEDIFF_REAL *mem, *wts, *offsets, *f, *tab, *steps, *e, *bx, *bfx, *cur, *prev, *fp;
+    FINITEDIFF_REAL est, errt, fac, scale;
+    const int r = npoints/2, nst = npoints, ntab = 2*max_rounds;
+    if (npoints % 2 == 0)
+        return FINITEDIFF_STATUS_ERR_BAD_ARGUMENT; /* no central stencil */
+    if (deriv < 0 || nst < deriv + 1 || max_rounds < 2)
+        return FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS;
+    if (len_x < 1)
+        goto exit0;
+    /* weights & offsets, values of the current stencil, two columns of the Richardson table,
+       steps, error estimates and the batch (abscissae & values) */
+    mem = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*(nst*(deriv+1) + nst + len_x*(nst + ntab + 2 + 2*nst)));
+    active = (int *)malloc(sizeof(int)*len_x);
+    if (!mem || !active) {
+        status = FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+        goto exit1;
+    }
+    wts = mem;
+    offsets = wts + nst*(deriv+1);
+    f = offsets + nst;
+    tab = f + len_x*nst;
+    steps = tab + len_x*ntab;
+    e = steps + len_x;
+    bx = e + len_x;
+    bfx = bx + len_x*nst;
+    for (k=0; k<nst; ++k)
+        offsets[k] = k - r;
+    finitediff_calculate_weights(wts, nst, offsets, nst, deriv, 0);
+    wts += deriv*nst;
+    /* central stencils: the error expands in even powers of h starting at h**order */
+    order = nst - deriv + ((nst - deriv) % 2);
+    for (i=0; i<len_x; ++i)
+        active[i] = i;
+    n_active = len_x;
+    for (round=0; round<max_rounds && n_active; ++round){
+        /* 1. all new abscissae of the round: full stencils first, then only the odd offsets */
+        nb = 0;
+        for (a=0; a<n_active; ++a){
+            i = active[a];
+            fp = f + i*nst;
+            if (round == 0) {
+                steps[i] = h0*(1 + FINITEDIFF_MAX(x[i], -x[i]));
+                for (k=0; k<nst; ++k)
+                    bx[nb++] = x[i] + (k - r)*steps[i];
+            } else {
+                steps[i] /= 2;
+                /* offset 2*m at half the step is offset m of the previous round (outermost first) */
+                for (k=nst-1; k>r; --k)
+                    if ((k - r) % 2 == 0)
+                        fp[k] = fp[r + (k - r)/2];
+                for (k=0; k<r; ++k)
+                    if ((r - k) % 2 == 0)
+                        fp[k] = fp[r - (r - k)/2];
+                for (k=0; k<nst; ++k)
+                    if ((k - r) % 2)
+                        bx[nb++] = x[i] + (k - r)*steps[i];
+            }
+        }
+        if (cb(bfx, bx, nb, user_data)) {
+            status = FINITEDIFF_STATUS_ERR_CALLBACK;
+            goto exit1;
+        }
+        nev += nb;
+        /* 2. estimates, Richardson extrapolation and error estimates */
+        nb = 0;
+        n_next = 0;
+        for (a=0; a<n_active; ++a){
+            i = active[a];
+            fp = f + i*nst;
+            for (k=0; k<nst; ++k)
+                if (round == 0 || (k - r) % 2)
+                    fp[k] = bfx[nb++];
+            scale = 1;
+            for (j=0; j<deriv; ++j)
+                scale /= steps[i];
+            est = 0;
+            for (k=0; k<nst; ++k)
+                est += wts[k]*fp[k];
+            cur = tab + i*ntab + (round % 2)*max_rounds;
+            prev = tab + i*ntab + ((round + 1) % 2)*max_rounds;
+            cur[0] = est*scale;
+            done = 0;
+            if (round == 0) {
+                out[i] = cur[0];
+                e[i] = -1; /* no estimate yet */
+            } else {
+                fac = 1;
+                for (j=0; j<order; ++j)
+                    fac *= 2;
+                for (j=1; j<=round; ++j){
+                    cur[j] = cur[j-1] + (cur[j-1] - prev[j-1])/(fac - 1);
+                    fac *= 4;
+                    errt = FINITEDIFF_MAX(FINITEDIFF_MAX(cur[j] - cur[j-1], cur[j-1] - cur[j]),
+                                          FINITEDIFF_MAX(cur[j] - prev[j-1], prev[j-1] - cur[j]));
+                    if (e[i] < 0 || errt <= e[i]) {
+                        e[i] = errt;
+                        out[i] = cur[j];
+                    }
+                }
+                /* converged, or round-off makes the diagonal drift away */
+                done = e[i] <= atol + rtol*FINITEDIFF_MAX(out[i], -out[i]) ||
+                    FINITEDIFF_MAX(cur[round] - prev[round-1], prev[round-1] - cur[round]) >= 2*e[i];
+            }
+            if (!done)
+                active[n_next++] = i;
+        }
+        n_active = n_next;
+    }
+    if (err) {
+        for (i=0; i<len_x; ++i)
+            err[i] = e[i];
+    }
+exit1:
+    free(mem);
+    free(active);
+exit0:
+    if (n_evals)
+        *n_evals = nev;
+    return status;
+}
+
+int finitediff_color_columns(
+    int * const FINITEDIFF_RESTRICT colors,
+    int * const n_colors,
+    const int nrows,
+    const int ncols,
+    const int * const FINITEDIFF_RESTRICT indptr,
+    const int * const FINITEDIFF_RESTRICT indices
+)
+{
+    /* greedy distance-2 colouring (columns sharing a row differ), largest degree first */
+    int status = FINITEDIFF_STATUS_SUCCESS, i, j, k, c, p, q, ncolors = 0;
+    int *col_ptr, *col_rows, *order, *forbidden, *pos;
+    const int nnz = indptr[nrows];
+    col_ptr = (int *)malloc(sizeof(int)*(ncols + 1));
+    col_rows = (int *)malloc(sizeof(int)*FINITEDIFF_MAX(nnz, 1));
+    order = (int *)malloc(sizeof(int)*FINITEDIFF_MAX(ncols, 1));
+    forbidden = (int *)malloc(sizeof(int)*FINITEDIFF_MAX(ncols, 1));
+    pos = (int *)malloc(sizeof(int)*(FINITEDIFF_MAX(ncols, nrows) + 1));
+    if (!col_ptr || !col_rows || !order || !forbidden || !pos) {
+        status = FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+        goto exit0;
+    }
+    /* transpose: rows of each column */
+    memset(col_ptr, 0, sizeof(int)*(ncols + 1));
+    for (p=0; p<nnz; ++p)
+        ++col_ptr[indices[p] + 1];
+    for (j=0; j<ncols; ++j)
+        col_ptr[j + 1] += col_ptr[j];
+    memcpy(pos, col_ptr, sizeof(int)*ncols);
+    for (i=0; i<nrows; ++i){
+        for (p=indptr[i]; p<indptr[i + 1]; ++p)
+            col_rows[pos[indices[p]]++] = i;
+    }
+    /* columns ordered by decreasing number of non-zeros (counting sort) */
+    memset(pos, 0, sizeof(int)*(nrows + 1));
+    for (j=0; j<ncols; ++j)
+        ++pos[nrows - (col_ptr[j + 1] - col_ptr[j])];
+    for (k=0, c=0; k<=nrows; ++k){
+        p = pos[k];
+        pos[k] = c;
+        c += p;
+    }
+    for (j=0; j<ncols; ++j)
+        order[pos[nrows - (col_ptr[j + 1] - col_ptr[j])]++] = j;
+    for (j=0; j<ncols; ++j){
+        colors[j] = -1;
+        forbidden[j] = -1;
+    }
+    for (k=0; k<ncols; ++k){
+        j = order[k];
+        for (p=col_ptr[j]; p<col_ptr[j + 1]; ++p){
+            i = col_rows[p];
+            for (q=indptr[i]; q<indptr[i + 1]; ++q){
+                if (colors[indices[q]] >= 0)
+                    forbidden[colors[indices[q]]] = j;
+            }
+        }
+        for (c=0; forbidden[c] == j; ++c)
+            ;
+        colors[j] = c;
+        ncolors = FINITEDIFF_MAX(ncolors, c + 1);
+    }
+    *n_colors = ncolors;
+exit0:
+    free(col_ptr);
+    free(col_rows);
+    free(order);
+    free(forbidden);
+    free(pos);
+    return status;
+}
+
+int finitediff_sparse_jacobian(
+    FINITEDIFF_REAL * const FINITEDIFF_RESTRICT data,
+    int * const n_evals,
+    finitediff_jacobian_callback cb,
+    void * const user_data,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT x0,
+    const int nrows,
+    const int ncols,
+    const int * const FINITEDIFF_RESTRICT indptr,
+    const int * const FINITEDIFF_RESTRICT indices,
+    const int * const FINITEDIFF_RESTRICT colors,
+    const int n_colors,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT offsets,
+    const int n_offsets,
+    const FINITEDIFF_REAL h,
+    const FINITEDIFF_REAL * const FINITEDIFF_RESTRICT f0,
+    const int max_batch
+)
+{
+    int status = FINITEDIFF_STATUS_SUCCESS, i, j, s, p, c, e, e0, nb, s0 = -1, npts = 0;
+    int *slot;
+    FINITEDIFF_REAL *w, *steps, *fx, *bx;
+    const FINITEDIFF_REAL * fzero = f0;
+    const int n_pt = n_colors*n_offsets + 1; /* (colour, offset) pairs and x0 */
+    if (n_offsets < 2)
+        return FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS;
+    for (s=0; s<n_offsets; ++s){
+        for (p=0; p<s; ++p){
+            if (offsets[p] == offsets[s])
+                return FINITEDIFF_STATUS_ERR_BAD_ARGUMENT; /* singular weights */
+        }
+    }
+    for (j=0; j<ncols; ++j){
+        if (colors[j] < 0 || colors[j] >= n_colors)
+            return FINITEDIFF_STATUS_ERR_BAD_ARGUMENT;
+    }
+    w = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*2*n_offsets);
+    steps = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*FINITEDIFF_MAX(ncols, 1));
+    slot = (int *)malloc(sizeof(int)*n_pt*2);
+    /* values at the evaluated points: fx[eval_idx*nrows + row] */
+    fx = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*FINITEDIFF_MAX(n_pt*nrows, 1));
+    nb = (max_batch > 0) ? FINITEDIFF_MIN(max_batch, n_pt) : n_pt;
+    bx = (FINITEDIFF_REAL *)malloc(sizeof(FINITEDIFF_REAL)*FINITEDIFF_MAX(nb*ncols, 1));
+    if (!w || !steps || !slot || !fx || !bx) {
+        status = FINITEDIFF_STATUS_ERR_BAD_ALLOC;
+        goto exit0;
+    }
+    /* columns sharing a row need different colours (slot[colour]: last row seen, n_pt > n_colors) */
+    for (c=0; c<n_colors; ++c)
+        slot[c] = -1;
+    for (i=0; i<nrows; ++i){
+        for (p=indptr[i]; p<indptr[i + 1]; ++p){
+            c = colors[indices[p]];
+            if (slot[c] == i) {
+                status = FINITEDIFF_STATUS_ERR_BAD_ARGUMENT;
+                goto exit0;
+            }
+            slot[c] = i;
+        }
+    }
+    finitediff_calculate_weights(w, n_offsets, offsets, n_offsets, 1, 0);
+    for (s=0; s<n_offsets; ++s){
+        if (offsets[s] == 0)
+            s0 = s; /* unperturbed point: f0 (evaluated once unless given) */
+    }
+    for (j=0; j<ncols; ++j)
+        steps[j] = h*(1 + FINITEDIFF_MAX(x0[j], -x0[j]));
+    /* slot[pt]: evaluation index of point pt (-1: none), slot[n_pt + e]: point of evaluation e */
+    for (c=0; c<n_colors; ++c){
+        for (s=0; s<n_offsets; ++s){
+            slot[c*n_offsets + s] = (s == s0) ? -1 : npts;
+            if (s != s0)
+                slot[n_pt + npts++] = c*n_offsets + s;
+        }
+    }
+    slot[n_pt - 1] = (s0 >= 0 && !f0) ? npts : -1;
+    if (s0 >= 0 && !f0)
+        slot[n_pt + npts++] = n_pt - 1;
+    /* all columns of a colour are perturbed together, points are passed to cb in batches of nb */
+    for (e0=0; e0<npts; e0 += nb){
+        for (e=e0; e<FINITEDIFF_MIN(e0 + nb, npts); ++e){
+            p = slot[n_pt + e];
+            memcpy(bx + (e - e0)*ncols, x0, sizeof(FINITEDIFF_REAL)*ncols);
+            if (p < n_pt - 1) {
+                for (j=0; j<ncols; ++j){
+                    if (colors[j] == p / n_offsets)
+                        bx[(e - e0)*ncols + j] += offsets[p % n_offsets]*steps[j];
+                }
+            }
+        }
+        if (cb(fx + e0*nrows, bx, e - e0, user_data)) {
+            status = FINITEDIFF_STATUS_ERR_CALLBACK;
+            goto exit0;
+        }
+    }
+    if (s0 >= 0 && !f0)
+        fzero = fx + slot[n_pt - 1]*nrows;
+    /* J[i, j] = sum_s w_s f(x0 + offsets[s]*h_j*e_colour(j))[i] / h_j (column j is the only one of its colour in row i) */
+    for (i=0; i<nrows; ++i){
+        for (p=indptr[i]; p<indptr[i + 1]; ++p){
+            j = indices[p];
+            data[p] = 0;
+            for (s=0; s<n_offsets; ++s){
+                e = slot[colors[j]*n_offsets + s];
+                data[p] += w[n_offsets + s]*((s == s0) ? fzero[i] : fx[e*nrows + i]);
+            }
+            data[p] /= steps[j];
+        }
+    }
+exit0:
+    free(w);
+    free(steps);
+    free(slot);
+    free(fx);
+    free(bx);
+    if (n_evals)
+        *n_evals = status ? 0 : npts;
+    return status;
+}
@@ -0,0 +1,88 @@
+/*
+  Timings of finitediff_calculate_weights (Fornberg's recursion) versus
+  finitediff_calculate_weights_barycentric for increasing stencil sizes:
+
+      $ make bench
+
+  Every target has its own stencil, one point further along a non-uniform grid
+  (as in finitediff_interpolate_by_finite_diff):
+  "bary" reuses the barycentric weights of one stencil for all targets (lower bound),
+  "bary+s" shifts them along with the stencil (recomputed in full every n shifts),
+  "bary+b" recomputes them for every target (worst case for the barycentric engine).
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <finitediff_c.h>
+
+#define NTGTS 2000
+
+static double elapsed_(clock_t t0){
+    return (double)(clock() - t0)/CLOCKS_PER_SEC;
+}
+
+int main(){
+    const int sizes[10] = {4, 6, 8, 12, 16, 24, 32, 48, 64, 100};
+    const int max_derivs[3] = {1, 2, 4};
+    int si, mi, n, m, t, j;
+    double *grid, *w, *b, work[5], cap, t_fb, t_bc, t_bcs, t_bcb, xtgt, sink = 0;
+    clock_t t0;
+    grid = malloc(sizeof(double)*(100 + NTGTS));
+    w = malloc(sizeof(double)*100*5);
+    b = malloc(sizeof(double)*100);
+    if (!grid || !w || !b)
+        return 1;
+    for (j=0; j<100 + NTGTS; ++j)
+        grid[j] = j + 0.1*sin(j);
+    printf("%4s %4s %12s %12s %12s %12s  (microseconds per target)\n",
+           "n", "m", "fornberg", "bary", "bary+s", "bary+b");
+    for (mi=0; mi<3; ++mi){
+        m = max_derivs[mi];
+        for (si=0; si<10; ++si){
+            n = sizes[si];
+            if (n < m + 1)
+                continue;
+            t0 = clock();
+            for (t=0; t<NTGTS; ++t){
+                xtgt = grid[t + n/2] - 0.3;
+                finitediff_calculate_weights(w, n, grid + t, n, m, xtgt);
+                sink += w[n/2];
+            }
+            t_fb = elapsed_(t0);
+            t0 = clock();
+            cap = finitediff_barycentric_weights(b, grid, n);
+            for (t=0; t<NTGTS; ++t){
+                xtgt = (n - 1)*(t + 0.5)/NTGTS;
+                finitediff_calculate_weights_barycentric(w, n, grid, n, m, xtgt, b, cap, work);
+                sink += w[n/2];
+            }
+            t_bc = elapsed_(t0);
+            t0 = clock();
+            for (t=0; t<NTGTS; ++t){
+                xtgt = grid[t + n/2] - 0.3;
+                if (t % n == 0)
+                    cap = finitediff_barycentric_weights(b, grid + t, n);
+                else
+                    finitediff_barycentric_weights_shift(b, grid + t, n, grid[t - 1], 1, cap);
+                finitediff_calculate_weights_barycentric(w, n, grid + t, n, m, xtgt, b, cap, work);
+                sink += w[n/2];
+            }
+            t_bcs = elapsed_(t0);
+            t0 = clock();
+            for (t=0; t<NTGTS; ++t){
+                xtgt = grid[t + n/2] - 0.3;
+                cap = finitediff_barycentric_weights(b, grid + t, n);
+                finitediff_calculate_weights_barycentric(w, n, grid + t, n, m, xtgt, b, cap, work);
+                sink += w[n/2];
+            }
+            t_bcb = elapsed_(t0);
+            printf("%4d %4d %12.3f %12.3f %12.3f %12.3f\n", n, m, 1e6*t_fb/NTGTS, 1e6*t_bc/NTGTS,
+                   1e6*t_bcs/NTGTS, 1e6*t_bcb/NTGTS);
+        }
+    }
+    free(grid);
+    free(w);
+    free(b);
+    return sink == 42.0; /* keep the optimizer from removing the loops */
+}
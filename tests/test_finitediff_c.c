@@ -58,6 +58,48 @@ int test_calculate_weights_5(){
     return 0;
 }
 
+int test_calculate_weights_barycentric(){
+    enum { len_g = 24, max_deriv = 3, nd = max_deriv + 1 };
+    double grid[len_g], ref[len_g*nd], w[len_g*nd], b[len_g], work[nd], cap;
+    double arounds[3];
+    int i, j;
+    for (i=0; i<len_g; ++i){
+        grid[i] = 0.1*i + 0.02*sin(i);
+    }
+    arounds[0] = grid[11];
+    arounds[1] = grid[11] + 1e-13;
+    arounds[2] = 0.777;
+    cap = finitediff_barycentric_weights(b, grid, len_g);
+    for (j=0; j<3; ++j){
+        finitediff_calculate_weights(ref, len_g, grid, len_g, max_deriv, arounds[j]);
+        finitediff_calculate_weights_barycentric(w, len_g, grid, len_g, max_deriv, arounds[j], b, cap, work);
+        for (i=0; i<len_g*nd; ++i){
+            if (fabs(w[i] - ref[i]) > 1e-8*(1 + fabs(ref[i]))){
+                return 1;
+            }
+        }
+    }
+    /* a stencil of 9 points moved one point at a time to the end of grid and back */
+    cap = finitediff_barycentric_weights(b, grid, 9);
+    for (j=1; j<2*(len_g - 9); ++j){
+        const int start = (j <= len_g - 9) ? j : 2*(len_g - 9) - j;
+        if (j <= len_g - 9) {
+            finitediff_barycentric_weights_shift(b, grid + start, 9, grid[start - 1], 1, cap);
+        } else {
+            finitediff_barycentric_weights_shift(b, grid + start, 9, grid[start + 9], -1, cap);
+        }
+        finitediff_calculate_weights(ref, 9, grid + start, 9, max_deriv, grid[start + 4] + 0.01);
+        finitediff_calculate_weights_barycentric(w, 9, grid + start, 9, max_deriv, grid[start + 4] + 0.01,
+                                                 b, cap, work);
+        for (i=0; i<9*nd; ++i){
+            if (fabs(w[i] - ref[i]) > 1e-10*(1 + fabs(ref[i]))){
+                return 10 + j;
+            }
+        }
+    }
+    return 0;
+}
+
 int get_ref_out_(
     double * ref,
     double * out,
@@ -141,6 +183,41 @@ int test_apply_fd()
     return 0;
 }
 
+int test_apply_fd_direct()
+{
+    /* same as forming the weights, also for targets on grid points and uneven spacing */
+    enum { max_deriv = 4, nd = max_deriv + 1, nsets = 2, len_grid = 12 };
+    double grid[len_grid], ydata[nsets*len_grid], w[len_grid*nd], ref[nsets*nd], out[nsets*nd];
+    double work[FINITEDIFF_DIRECT_WORK_LEN(len_grid, max_deriv)];
+    double xtgts[4];
+    int i, k;
+    for (k=0; k<len_grid; ++k){
+        grid[k] = 0.1*k + 0.03*sin(3.0*k);
+        ydata[k] = exp(grid[k]);
+        ydata[len_grid + k] = cos(grid[k]);
+    }
+    xtgts[0] = grid[0];
+    xtgts[1] = grid[5];
+    xtgts[2] = 0.5*(grid[6] + grid[7]);
+    xtgts[3] = grid[len_grid-1] + 0.05;
+    for (i=0; i<4; ++i){
+        finitediff_calculate_weights(w, len_grid, grid, len_grid, max_deriv, xtgts[i]);
+        finitediff_apply_fd(ref, nd, w, len_grid, nsets, max_deriv, len_grid, ydata, len_grid);
+        finitediff_apply_fd_direct(out, nd, nsets, max_deriv, len_grid, grid, ydata, len_grid, xtgts[i], work);
+        for (k=0; k<nsets*nd; ++k){
+            if (fabs(out[k] - ref[k]) > pow(10, k % nd - 10)*(1 + fabs(ref[k]))){
+                return 1 + i;
+            }
+        }
+        /* dispatched to the direct path */
+        if (finitediff_calc_and_apply_fd(out, nd, 1, max_deriv, len_grid, grid, ydata, len_grid, xtgts[i]) ||
+            fabs(out[1] - ref[1]) > 1e-9*(1 + fabs(ref[1]))){
+            return 10 + i;
+        }
+    }
+    return 0;
+}
+
 int test_interpolate_by_finite_diff() {
     double * out;
     const int len_tgts = 5, nsets = 4, max_deriv = 2;
@@ -197,12 +274,649 @@ exit0:
     return flag;
 }
 
+int test_interpolate_by_finite_diff_layout() {
+    enum { len_tgts = 7, nsets = 3, max_deriv = 2, len_grid = 6, nd = max_deriv + 1 };
+    const int ntail=2, nhead=2;
+    const double grid[len_grid] = {0.0, 0.5, 1.1, 1.5, 2.2, 3.0};
+    const double xtgts[len_tgts] = {-0.1, 0.3, 0.8, 1.2, 1.9, 2.5, 3.1};
+    double y_sg[nsets*len_grid], y_gs[len_grid*nsets];
+    double ref[len_tgts*nsets*nd], out[len_tgts*nsets*nd];
+    int i, j, k, ydl, flag = 0;
+    for (i=0; i<nsets; ++i){
+        for (k=0; k<len_grid; ++k){
+            y_sg[i*len_grid + k] = y_gs[k*nsets + i] = (i+1)*exp(grid[k]) - i;
+        }
+    }
+    flag = finitediff_interpolate_by_finite_diff(ref, len_tgts, nsets, max_deriv, nsets*nd, nd,
+                                                 ntail, nhead, grid, len_grid, y_sg, len_grid, xtgts);
+    if (flag) {
+        return 100 + flag;
+    }
+    for (ydl=0; ydl<2; ++ydl){
+        /* out[tgt, set, deriv] */
+        flag = finitediff_interpolate_by_finite_diff_layout(
+            out, len_tgts, nsets, max_deriv, FINITEDIFF_OUT_TGT_SET_DERIV, nsets*nd, nd, ntail, nhead, grid, len_grid,
+            ydl ? y_gs : y_sg, ydl ? FINITEDIFF_YDATA_GRID_SET : FINITEDIFF_YDATA_SET_GRID, ydl ? nsets : len_grid, xtgts);
+        if (flag) {
+            return 200 + flag;
+        }
+        for (i=0; i<len_tgts*nsets*nd; ++i){
+            if (fabs(out[i] - ref[i]) > 1e-12){
+                return 300 + i;
+            }
+        }
+        /* out[deriv, set, tgt] */
+        flag = finitediff_interpolate_by_finite_diff_layout(
+            out, len_tgts, nsets, max_deriv, FINITEDIFF_OUT_DERIV_SET_TGT, nsets*len_tgts, len_tgts, ntail, nhead,
+            grid, len_grid, ydl ? y_gs : y_sg, ydl ? FINITEDIFF_YDATA_GRID_SET : FINITEDIFF_YDATA_SET_GRID,
+            ydl ? nsets : len_grid, xtgts);
+        if (flag) {
+            return 400 + flag;
+        }
+        for (i=0; i<len_tgts; ++i){
+            for (j=0; j<nsets; ++j){
+                for (k=0; k<nd; ++k){
+                    if (fabs(out[(k*nsets + j)*len_tgts + i] - ref[(i*nsets + j)*nd + k]) > 1e-12){
+                        return 500 + i;
+                    }
+                }
+            }
+        }
+    }
+    if (finitediff_interpolate_by_finite_diff_layout(
+            out, len_tgts, nsets, max_deriv, 2, nsets*nd, nd, ntail, nhead, grid, len_grid,
+            y_sg, FINITEDIFF_YDATA_SET_GRID, len_grid, xtgts) != FINITEDIFF_STATUS_ERR_UNKNOWN_LAYOUT) {
+        return 600;
+    }
+    return 0;
+}
+
+int test_autotune_interpolate() {
+    enum { len_tgts = 9, nsets = 6, max_deriv = 1, len_grid = 8, nd = max_deriv + 1 };
+    const int ntail=2, nhead=2;
+    const char * const path = "test_finitediff_c.tuning";
+    double grid[len_grid], ydata[nsets*len_grid], xtgts[len_tgts];
+    double ref[len_tgts*nsets*nd], out[len_tgts*nsets*nd];
+    int i, k, flag;
+    for (k=0; k<len_grid; ++k){
+        grid[k] = k*0.3 + 0.01*k*k;
+        for (i=0; i<nsets; ++i){
+            ydata[i*len_grid + k] = sin(grid[k] + i);
+        }
+    }
+    for (i=0; i<len_tgts; ++i){
+        xtgts[i] = 0.25*i;
+    }
+    finitediff_tuning_clear();
+    flag = finitediff_interpolate_by_finite_diff(ref, len_tgts, nsets, max_deriv, nsets*nd, nd,
+                                                 ntail, nhead, grid, len_grid, ydata, len_grid, xtgts);
+    if (flag) {
+        return 100 + flag;
+    }
+    flag = finitediff_autotune_interpolate(out, len_tgts, nsets, max_deriv, FINITEDIFF_OUT_TGT_SET_DERIV, nsets*nd, nd,
+                                           ntail, nhead, grid, len_grid, ydata, FINITEDIFF_YDATA_SET_GRID, len_grid, xtgts);
+    if (flag) {
+        return 200 + flag;
+    }
+    if (finitediff_tuning_save(path) || (finitediff_tuning_clear(), finitediff_tuning_load(path))) {
+        return 300;
+    }
+    remove(path);
+    for (i=0; i<len_tgts*nsets*nd; ++i){
+        out[i] = 0;
+    }
+    flag = finitediff_interpolate_by_finite_diff(out, len_tgts, nsets, max_deriv, nsets*nd, nd,
+                                                 ntail, nhead, grid, len_grid, ydata, len_grid, xtgts);
+    finitediff_tuning_clear();
+    if (flag) {
+        return 400 + flag;
+    }
+    for (i=0; i<len_tgts*nsets*nd; ++i){
+        if (fabs(out[i] - ref[i]) > 1e-13){
+            return 500 + i;
+        }
+    }
+    if (finitediff_tuning_load("non-existent/finitediff.tuning") != FINITEDIFF_STATUS_ERR_IO) {
+        return 600;
+    }
+    return 0;
+}
+
+int test_apply_variants() {
+    /* each kernel variant forced through a tuning entry, compared with the naive kernel */
+    enum { len_tgts = 5, max_nsets = 7, max_deriv = 2, len_grid = 9, nd = max_deriv + 1 };
+    const int ntail=3, nhead=3, nsets_cases[3] = {1, 4, 7};
+    const char * const path = "test_finitediff_c.variants";
+    double grid[len_grid], ydata[max_nsets*len_grid], xtgts[len_tgts];
+    double ref[len_tgts*max_nsets*nd], out[len_tgts*max_nsets*nd];
+    int i, k, c, nsets, ol, variant, flag;
+    FILE * fh;
+    for (k=0; k<len_grid; ++k){
+        grid[k] = 0.4*k + 0.02*k*k;
+        for (i=0; i<max_nsets; ++i){
+            ydata[i*len_grid + k] = cos(grid[k] - i) + i;
+        }
+    }
+    for (i=0; i<len_tgts; ++i){
+        xtgts[i] = 0.7*i + 0.1;
+    }
+    for (c=0; c<3; ++c){
+        nsets = nsets_cases[c];
+        for (ol=0; ol<2; ++ol){
+            for (variant=FINITEDIFF_APPLY_NAIVE; variant<=FINITEDIFF_APPLY_BLOCKED; ++variant){
+                fh = fopen(path, "w");
+                if (!fh) {
+                    return 100;
+                }
+                /* nin lg2_nsets lg2_len_targets max_deriv ydata_layout out_layout n_threads apply_variant */
+                fprintf(fh, "%d %d %d %d %d %d 1 %d\n", ntail + nhead, nsets >= 4 ? 2 : 0, 2, max_deriv,
+                        FINITEDIFF_YDATA_SET_GRID, ol, variant);
+                fclose(fh);
+                finitediff_tuning_clear();
+                flag = finitediff_tuning_load(path);
+                remove(path);
+                if (flag) {
+                    return 200 + flag;
+                }
+                flag = finitediff_interpolate_by_finite_diff_layout(
+                    variant ? out : ref, len_tgts, nsets, max_deriv, ol,
+                    ol ? nsets*len_tgts : nsets*nd, ol ? len_tgts : nd, ntail, nhead,
+                    grid, len_grid, ydata, FINITEDIFF_YDATA_SET_GRID, len_grid, xtgts);
+                if (flag) {
+                    return 300 + flag;
+                }
+            }
+            for (i=0; i<len_tgts*nsets*nd; ++i){
+                if (fabs(out[i] - ref[i]) > 1e-13*(1 + fabs(ref[i]))){
+                    return 400 + 10*c + ol;
+                }
+            }
+        }
+    }
+    finitediff_tuning_clear();
+    /* out of range variant/engine: line ignored */
+    fh = fopen(path, "w");
+    if (!fh) {
+        return 500;
+    }
+    fprintf(fh, "6 0 2 2 0 0 1 7\n6 0 2 2 0 1 1 0 -1\n");
+    fclose(fh);
+    flag = finitediff_tuning_load(path);
+    remove(path);
+    if (flag || finitediff_tuning_save(path)) {
+        return 600;
+    }
+    fh = fopen(path, "r");
+    k = 0;
+    while (fh && fgets((char *)out, sizeof(out), fh)) {
+        ++k;
+    }
+    if (fh) {
+        fclose(fh);
+    }
+    remove(path);
+    finitediff_tuning_clear();
+    return (k == 1) ? 0 : 700; /* header only */
+}
+
+int test_weights_file() {
+    enum { len_tgts = 5, nsets = 4, max_deriv = 2, len_grid = 3, nd = max_deriv + 1 };
+    const char * const path = "test_finitediff_c.weights";
+    const double grid[3] = {0.0, 1.0, 2.0};
+    const double ydata[3*4] = {2.0, 3.0, 5.0,
+                               3.0, 4.0, 7.0,
+                               7.0, 8.0, 9.0,
+                               3.0, 4.0, 6.0};
+    const double xtgts[5] = {0.5 , 0.75, 1.  , 1.25, 1.5};
+    double ref[len_tgts*nsets*nd], out[len_tgts*nsets*nd];
+    finitediff_weights_view view;
+    const void * data;
+    void * buf;
+    size_t nbytes;
+    int i, flag;
+    flag = finitediff_interpolate_by_finite_diff(ref, len_tgts, nsets, max_deriv, nsets*nd, nd,
+                                                 2, 2, grid, len_grid, ydata, len_grid, xtgts);
+    if (flag) {
+        return 100 + flag;
+    }
+    flag = finitediff_weights_write(path, grid, len_grid, xtgts, len_tgts, max_deriv, 2, 2);
+    if (flag) {
+        return 200 + flag;
+    }
+    flag = finitediff_weights_mmap(&view, &data, &nbytes, path);
+    remove(path);
+    if (flag) {
+        return 300 + flag;
+    }
+    if (view.len_targets != len_tgts || view.max_deriv != max_deriv || view.stencil_len != len_grid ||
+        ((size_t)view.weights) % 64 || view.xtgts[4] != 1.5) {
+        return 400;
+    }
+    flag = finitediff_apply_weights_view(out, nsets, FINITEDIFF_OUT_TGT_SET_DERIV, nsets*nd, nd,
+                                         &view, ydata, FINITEDIFF_YDATA_SET_GRID, len_grid);
+    if (flag) {
+        return 500 + flag;
+    }
+    for (i=0; i<len_tgts*nsets*nd; ++i){
+        if (fabs(out[i] - ref[i]) > 1e-14){
+            return 600 + i;
+        }
+    }
+    if (finitediff_weights_view_init(&view, data, 63) != FINITEDIFF_STATUS_ERR_BAD_FORMAT ||
+        finitediff_weights_view_init(&view, ydata, sizeof(ydata)) != FINITEDIFF_STATUS_ERR_BAD_FORMAT) {
+        return 700;
+    }
+    flag = finitediff_weights_munmap(data, nbytes);
+    if (flag) {
+        return 800 + flag;
+    }
+    /* a stencil start beyond the grid is rejected */
+    nbytes = finitediff_weights_nbytes(len_tgts, max_deriv, len_grid);
+    buf = malloc(nbytes);
+    if (!buf) {
+        return 900;
+    }
+    flag = finitediff_weights_build(buf, nbytes, grid, len_grid, xtgts, len_tgts, max_deriv, 2, 2) ||
+        finitediff_weights_view_init(&view, buf, nbytes);
+    if (!flag) {
+        ((int *)buf)[view.starts - (const int *)buf + 2] = 1;
+        flag = (finitediff_weights_view_init(&view, buf, nbytes) != FINITEDIFF_STATUS_ERR_BAD_FORMAT);
+    }
+    free(buf);
+    return flag ? 1000 : 0;
+}
+
+int test_interpolate_by_finite_diff_wide() {
+    /* stencils of 20 points: Fornberg engine by default, barycentric when selected by a tuning entry */
+    enum { len_tgts = 22, max_deriv = 3, len_grid = 60, nd = max_deriv + 1 };
+    const char * const path = "test_finitediff_c.engine";
+    double grid[len_grid], ydata[len_grid], xtgts[len_tgts], out[len_tgts*nd], ref[len_tgts*nd];
+    int i, k, engine, flag, ndiffer = 0;
+    FILE * fh;
+    for (i=0; i<len_grid; ++i){
+        grid[i] = 0.05*i;
+        ydata[i] = exp(grid[i]);
+    }
+    for (i=0; i<len_tgts; ++i){
+        /* far apart, then one grid point apart (stencils moving by one point) */
+        xtgts[i] = (i < 11) ? 0.27*i + 0.01 : 1 + 0.05*(i - 11) + 0.01;
+    }
+    for (engine=FINITEDIFF_WEIGHTS_FORNBERG; engine<=FINITEDIFF_WEIGHTS_BARYCENTRIC; ++engine){
+        finitediff_tuning_clear();
+        if (engine == FINITEDIFF_WEIGHTS_BARYCENTRIC) {
+            fh = fopen(path, "w");
+            if (!fh) {
+                return 1;
+            }
+            fprintf(fh, "20 0 4 %d 0 0 1 0 %d\n", max_deriv, engine);
+            fclose(fh);
+            flag = finitediff_tuning_load(path);
+            remove(path);
+            if (flag) {
+                return 2;
+            }
+        }
+        if (finitediff_interpolate_by_finite_diff(engine ? out : ref, len_tgts, 1, max_deriv, nd, nd, 10, 10,
+                                                  grid, len_grid, ydata, len_grid, xtgts)) {
+            return 3;
+        }
+    }
+    finitediff_tuning_clear();
+    for (i=0; i<len_tgts; ++i){
+        for (k=0; k<nd; ++k){
+            if (fabs(out[i*nd + k] - exp(xtgts[i])) > pow(10, -11.5 + 2*k)*exp(xtgts[i]) ||
+                fabs(ref[i*nd + k] - exp(xtgts[i])) > pow(10, -11.5 + 2*k)*exp(xtgts[i])){
+                return 4;
+            }
+            ndiffer += out[i*nd + k] != ref[i*nd + k];
+        }
+    }
+    return ndiffer ? 0 : 5; /* identical results: same engine used twice */
+}
+
+int test_plan_moving_grid() {
+    enum { len_tgts = 40, nsets = 2, max_deriv = 2, len_grid = 30, nd = max_deriv + 1 };
+    double grid[len_grid], ydata[nsets*len_grid], xtgts[len_tgts];
+    double ref[len_tgts*nsets*nd], out[len_tgts*nsets*nd];
+    finitediff_plan * plan;
+    finitediff_weights_view view;
+    int i, k, flag, n_refreshed;
+    for (k=0; k<len_grid; ++k){
+        grid[k] = 0.1*k;
+    }
+    for (i=0; i<len_tgts; ++i){
+        xtgts[i] = 0.07*i + 0.05;
+    }
+    flag = finitediff_plan_create(&plan, grid, len_grid, xtgts, len_tgts, max_deriv, 2, 2, 1e-6);
+    if (flag) {
+        return 100 + flag;
+    }
+    /* unchanged grid: nothing to do */
+    flag = finitediff_plan_update(plan, grid, NULL, &n_refreshed);
+    if (flag || n_refreshed != 0) {
+        flag = 200;
+        goto exit1;
+    }
+    /* a tiny move (below tolerance) and one point moving substantially */
+    grid[3] += 1e-12;
+    grid[20] += 0.02;
+    flag = finitediff_plan_update(plan, grid, NULL, &n_refreshed);
+    if (flag || n_refreshed == 0 || n_refreshed > 8) {
+        flag = 300;
+        goto exit1;
+    }
+    for (i=0; i<nsets; ++i){
+        for (k=0; k<len_grid; ++k){
+            ydata[i*len_grid + k] = sin(grid[k]) + i;
+        }
+    }
+    flag = finitediff_interpolate_by_finite_diff(ref, len_tgts, nsets, max_deriv, nsets*nd, nd,
+                                                 2, 2, grid, len_grid, ydata, len_grid, xtgts);
+    finitediff_plan_view(plan, &view);
+    flag = flag || finitediff_apply_weights_view(out, nsets, FINITEDIFF_OUT_TGT_SET_DERIV, nsets*nd, nd,
+                                                 &view, ydata, FINITEDIFF_YDATA_SET_GRID, len_grid);
+    if (flag) {
+        flag = 400;
+        goto exit1;
+    }
+    for (i=0; i<len_tgts*nsets*nd; ++i){
+        if (fabs(out[i] - ref[i]) > 1e-8){
+            flag = 500 + i;
+            goto exit1;
+        }
+    }
+    /* moving the targets shifts windows */
+    for (i=0; i<len_tgts; ++i){
+        xtgts[i] += 0.05;
+    }
+    flag = finitediff_plan_update(plan, grid, xtgts, &n_refreshed);
+    if (flag || n_refreshed != len_tgts) {
+        flag = 600;
+        goto exit1;
+    }
+    /* steps of 0.6*tol (tol = rtol*stencil width) add up: stale after the second step */
+    for (k=0; k<2; ++k){
+        xtgts[11] += 0.6*1e-6*0.3;
+        flag = finitediff_plan_update(plan, grid, xtgts, &n_refreshed);
+        if (flag || n_refreshed != k) {
+            flag = 700 + k;
+            goto exit1;
+        }
+    }
+exit1:
+    finitediff_plan_destroy(plan);
+    return flag;
+}
+
+
+int test_differentiate_on_grid() {
+    /* uniform, stretched and again uniform parts: compare with one stencil per node */
+    enum { len_grid = 700, nsets = 3, max_deriv = 2, npoints = 5, nd = max_deriv + 1 };
+    static double grid[len_grid], ydata[nsets*len_grid], out[nsets*nd*len_grid];
+    double ref[nsets*nd];
+    int i, j, k, start, flag;
+    for (k=0; k<len_grid; ++k){
+        grid[k] = (k < 300) ? 0.01*k : ((k < 400) ? 3 + 0.01*(k-300)*(1 + 0.01*(k-300)) : 5 + 0.02*(k-400));
+        for (i=0; i<nsets; ++i){
+            ydata[i*len_grid + k] = sin(grid[k]) + i*grid[k];
+        }
+    }
+    flag = finitediff_differentiate_on_grid(out, nd*len_grid, len_grid, nsets, max_deriv, npoints,
+                                            grid, len_grid, ydata, len_grid);
+    if (flag) {
+        return 100 + flag;
+    }
+    for (k=0; k<len_grid; ++k){
+        start = FINITEDIFF_MAX(0, FINITEDIFF_MIN(k - (npoints - 1)/2, len_grid - npoints));
+        finitediff_calc_and_apply_fd(ref, nd, nsets, max_deriv, npoints, grid + start,
+                                     ydata + start, len_grid, grid[k]);
+        for (i=0; i<nsets; ++i){
+            for (j=0; j<nd; ++j){
+                if (fabs(out[i*nd*len_grid + j*len_grid + k] - ref[i*nd + j]) > 1e-7*pow(10, j)){
+                    return 1000 + k;
+                }
+            }
+        }
+    }
+    /* too few points for the second derivative */
+    if (finitediff_differentiate_on_grid(out, nd*len_grid, len_grid, nsets, max_deriv, 2,
+                                         grid, len_grid, ydata, len_grid) != FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS) {
+        return 200;
+    }
+    return 0;
+}
+
+int test_interpolate_periodic() {
+    /* compare with a (three times) padded copy of grid and ydata */
+    enum { len_grid = 20, nsets = 2, max_deriv = 2, len_tgts = 7, nd = max_deriv + 1, ntail = 3, nhead = 3 };
+    const double period = 2*3.141592653589793;
+    double grid[len_grid], ydata[nsets*len_grid], ydata_gs[len_grid*nsets];
+    double pgrid[3*len_grid], pydata[nsets*3*len_grid];
+    double xtgts[len_tgts] = {-7.0, -0.01, 0.0, 0.05, 3.0, 6.25, 13.0}, xred[len_tgts];
+    double ref[len_tgts*nsets*nd], out[len_tgts*nsets*nd];
+    int i, k, flag;
+    for (k=0; k<len_grid; ++k){
+        grid[k] = period*(k + 0.3*sin(k))/len_grid;
+        for (i=0; i<nsets; ++i){
+            ydata[i*len_grid + k] = ydata_gs[k*nsets + i] = sin(grid[k] + i);
+        }
+    }
+    for (k=0; k<3*len_grid; ++k){
+        pgrid[k] = grid[k % len_grid] + period*(k/len_grid - 1);
+        for (i=0; i<nsets; ++i){
+            pydata[i*3*len_grid + k] = ydata[i*len_grid + k % len_grid];
+        }
+    }
+    for (i=0; i<len_tgts; ++i){
+        xred[i] = xtgts[i] - period*floor(xtgts[i]/period);
+    }
+    flag = finitediff_interpolate_by_finite_diff(ref, len_tgts, nsets, max_deriv, nsets*nd, nd, ntail, nhead,
+                                                 pgrid, 3*len_grid, pydata, 3*len_grid, xred);
+    flag = flag || finitediff_interpolate_periodic(out, len_tgts, nsets, max_deriv, FINITEDIFF_OUT_TGT_SET_DERIV,
+                                                   nsets*nd, nd, ntail, nhead, grid, len_grid, period,
+                                                   ydata, FINITEDIFF_YDATA_SET_GRID, len_grid, xtgts);
+    if (flag) {
+        return 100 + flag;
+    }
+    for (i=0; i<len_tgts*nsets*nd; ++i){
+        if (fabs(out[i] - ref[i]) > 1e-9){
+            return 200 + i;
+        }
+    }
+    /* grid-major ydata */
+    flag = finitediff_interpolate_periodic(out, len_tgts, nsets, max_deriv, FINITEDIFF_OUT_TGT_SET_DERIV,
+                                           nsets*nd, nd, ntail, nhead, grid, len_grid, period,
+                                           ydata_gs, FINITEDIFF_YDATA_GRID_SET, nsets, xtgts);
+    if (flag) {
+        return 300 + flag;
+    }
+    for (i=0; i<len_tgts*nsets*nd; ++i){
+        if (fabs(out[i] - ref[i]) > 1e-9){
+            return 400 + i;
+        }
+    }
+    if (finitediff_interpolate_periodic(out, len_tgts, nsets, max_deriv, FINITEDIFF_OUT_TGT_SET_DERIV,
+                                        nsets*nd, nd, ntail, nhead, grid, len_grid, grid[len_grid-1] - grid[0],
+                                        ydata, FINITEDIFF_YDATA_SET_GRID, len_grid, xtgts)
+        != FINITEDIFF_STATUS_ERR_BAD_PERIOD) {
+        return 500;
+    }
+    /* targets one period apart (reduction of x0 +/- period is inexact for these offsets x0) */
+    for (i=0; i<2; ++i){
+        const double x0 = (i == 0) ? 0.1 : 2.069;
+        for (k=0; k<len_grid; ++k){
+            pgrid[k] = grid[k] + x0;
+        }
+        xred[0] = x0; xred[1] = x0 + period; xred[2] = x0 - period;
+        flag = finitediff_interpolate_periodic(out, 3, nsets, max_deriv, FINITEDIFF_OUT_TGT_SET_DERIV,
+                                               nsets*nd, nd, ntail, nhead, pgrid, len_grid, period,
+                                               ydata, FINITEDIFF_YDATA_SET_GRID, len_grid, xred);
+        if (flag) {
+            return 600 + flag;
+        }
+        for (k=0; k<2*nsets*nd; ++k){
+            if (fabs(out[nsets*nd + k] - out[k % (nsets*nd)]) > 1e-12){
+                return 700 + 10*i + k;
+            }
+        }
+    }
+    return 0;
+}
+
+static int exp_batch_(double * const fx, const double * const x, const int n, void * const user_data){
+    int i;
+    ++*(int *)user_data;
+    for (i=0; i<n; ++i){
+        fx[i] = exp(x[i]);
+    }
+    return 0;
+}
+
+static int failing_batch_(double * const fx, const double * const x, const int n, void * const user_data){
+    (void)fx; (void)x; (void)n; (void)user_data;
+    return 1;
+}
+
+int test_differentiate_function() {
+    enum { len_x = 5 };
+    const double x[len_x] = {-3.0, -0.5, 0.0, 1.0, 4.0};
+    double out[len_x], err[len_x];
+    int i, deriv, npoints, n_calls, n_evals, n_rounds, flag;
+    for (deriv=1; deriv<=3; ++deriv){
+        for (npoints=3; npoints<=5; npoints += 2){
+            if (npoints < deriv + 1)
+                continue;
+            n_calls = 0;
+            flag = finitediff_differentiate_function(out, err, &n_evals, exp_batch_, &n_calls, x, len_x,
+                                                     deriv, npoints, 0.1, 1e-10, 0, 12);
+            if (flag) {
+                return 100 + flag;
+            }
+            /* one call per round, odd offsets only after the first round */
+            n_rounds = n_calls;
+            if (n_rounds < 2 || n_rounds > 12 || n_evals > len_x*(npoints + (n_rounds - 1)*2*((npoints/2 + 1)/2))) {
+                return 200 + deriv*10 + npoints;
+            }
+            for (i=0; i<len_x; ++i){
+                if (fabs(out[i] - exp(x[i])) > 1e-7*exp(x[i]) || !(err[i] >= 0) || err[i] > 1e-6*exp(x[i])){
+                    return 300 + deriv*10 + npoints;
+                }
+            }
+        }
+    }
+    if (finitediff_differentiate_function(out, NULL, NULL, failing_batch_, NULL, x, len_x, 1, 3, 0.1,
+                                          1e-10, 0, 12) != FINITEDIFF_STATUS_ERR_CALLBACK) {
+        return 400;
+    }
+    if (finitediff_differentiate_function(out, NULL, NULL, exp_batch_, &n_calls, x, len_x, 3, 3, 0.1,
+                                          1e-10, 0, 12) != FINITEDIFF_STATUS_ERR_TOO_FEW_POINTS) {
+        return 500;
+    }
+    if (finitediff_differentiate_function(out, NULL, NULL, exp_batch_, &n_calls, x, len_x, 1, 4, 0.1,
+                                          1e-10, 0, 12) != FINITEDIFF_STATUS_ERR_BAD_ARGUMENT) {
+        return 600; /* even number of points */
+    }
+    return 0;
+}
+
+/* f_i(x) = x_{i-1}**2 + sin(x_i) + x_i*x_{i+1} (tridiagonal Jacobian) */
+enum { jac_n = 50 };
+
+static int tridiag_batch_(double * const fx, const double * const x, const int n, void * const user_data){
+    int k, i;
+    const double * xk;
+    ++*(int *)user_data;
+    for (k=0; k<n; ++k){
+        xk = x + k*jac_n;
+        for (i=0; i<jac_n; ++i){
+            fx[k*jac_n + i] = sin(xk[i]) + ((i > 0) ? xk[i-1]*xk[i-1] : 0) + ((i < jac_n - 1) ? xk[i]*xk[i+1] : 0);
+        }
+    }
+    return 0;
+}
+
+int test_sparse_jacobian() {
+    int indptr[jac_n + 1], indices[3*jac_n], colors[jac_n];
+    double x0[jac_n], data[3*jac_n], ref;
+    const double central[2] = {-1, 1}, forward[2] = {0, 1}, repeated[3] = {-1, 1, 1};
+    int i, j, p, nnz = 0, n_colors, n_calls = 0, n_evals, flag;
+    for (i=0; i<jac_n; ++i){
+        x0[i] = 0.1*i - 1;
+        indptr[i] = nnz;
+        for (j=FINITEDIFF_MAX(i-1, 0); j<=FINITEDIFF_MIN(i+1, jac_n-1); ++j)
+            indices[nnz++] = j;
+    }
+    indptr[jac_n] = nnz;
+    flag = finitediff_color_columns(colors, &n_colors, jac_n, jac_n, indptr, indices);
+    if (flag || n_colors != 3) {
+        return 100;
+    }
+    for (i=0; i<jac_n; ++i){
+        for (p=indptr[i]; p<indptr[i+1]; ++p){
+            for (j=indptr[i]; j<p; ++j){
+                if (colors[indices[j]] == colors[indices[p]])
+                    return 200 + i;
+            }
+        }
+    }
+    /* central differences, two points per colour, batches of at most 4 points */
+    flag = finitediff_sparse_jacobian(data, &n_evals, tridiag_batch_, &n_calls, x0, jac_n, jac_n, indptr, indices,
+                                      colors, n_colors, central, 2, 1e-5, NULL, 4);
+    if (flag || n_evals != 6 || n_calls != 2) {
+        return 300;
+    }
+    for (i=0; i<jac_n; ++i){
+        for (p=indptr[i]; p<indptr[i+1]; ++p){
+            j = indices[p];
+            ref = (j == i - 1) ? 2*x0[i-1] : ((j == i) ? cos(x0[i]) + ((i < jac_n - 1) ? x0[i+1] : 0) : x0[i]);
+            if (fabs(data[p] - ref) > 1e-8){
+                return 400 + p;
+            }
+        }
+    }
+    /* forward differences: f(x0) is evaluated once */
+    n_calls = 0;
+    flag = finitediff_sparse_jacobian(data, &n_evals, tridiag_batch_, &n_calls, x0, jac_n, jac_n, indptr, indices,
+                                      colors, n_colors, forward, 2, 1e-7, NULL, 0);
+    if (flag || n_evals != 4 || n_calls != 1 || fabs(data[0] - cos(x0[0]) - x0[1]) > 1e-5) {
+        return 500;
+    }
+    /* rejected without evaluations: repeated offsets, a colour out of range, a row with one colour twice */
+    n_calls = 0;
+    if (finitediff_sparse_jacobian(data, NULL, tridiag_batch_, &n_calls, x0, jac_n, jac_n, indptr, indices,
+                                   colors, n_colors, repeated, 3, 1e-5, NULL, 0) != FINITEDIFF_STATUS_ERR_BAD_ARGUMENT) {
+        return 600;
+    }
+    colors[0] = -1;
+    flag = finitediff_sparse_jacobian(data, NULL, tridiag_batch_, &n_calls, x0, jac_n, jac_n, indptr, indices,
+                                      colors, n_colors, central, 2, 1e-5, NULL, 0);
+    colors[0] = colors[1];
+    if (flag != FINITEDIFF_STATUS_ERR_BAD_ARGUMENT ||
+        finitediff_sparse_jacobian(data, NULL, tridiag_batch_, &n_calls, x0, jac_n, jac_n, indptr, indices,
+                                   colors, n_colors, central, 2, 1e-5, NULL, 0) != FINITEDIFF_STATUS_ERR_BAD_ARGUMENT ||
+        n_calls) {
+        return 700;
+    }
+    return 0;
+}
 
 int main(){
     if (test_calculate_weights_3() ||
         test_calculate_weights_5() ||
+        test_calculate_weights_barycentric() ||
         test_apply_fd() ||
-        test_interpolate_by_finite_diff()
+        test_apply_fd_direct() ||
+        test_interpolate_by_finite_diff() ||
+        test_interpolate_by_finite_diff_layout() ||
+        test_autotune_interpolate() ||
+        test_apply_variants() ||
+        test_weights_file() ||
+        test_interpolate_by_finite_diff_wide() ||
+        test_plan_moving_grid() ||
+        test_differentiate_on_grid() ||
+        test_interpolate_periodic() ||
+        test_differentiate_function() ||
+        test_sparse_jacobian()
         ) {
         return 1;
     }
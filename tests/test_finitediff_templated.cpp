@@ -1,6 +1,7 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main()
 #include "catch.hpp"
 #include "finitediff_templated.hpp"
+#include "finitediff_c.h"
 #include <vector>
 #include <cmath>
 
@@ -56,6 +57,96 @@ TEST_CASE( "weight correctness", "finitediff::generate_weights") {
 
 }
 
+TEST_CASE( "barycentric weights", "finitediff::calculate_weights_barycentric") {
+    std::vector<double> x5 {-2, -1, 0, 1, 2};
+    auto coeffs5 = finitediff::generate_weights(x5, 2, 0.0, finitediff::WeightsEngine::barycentric);
+    REQUIRE( abs_(coeffs5[2] - 1) < 1e-14 );
+    REQUIRE( abs_(coeffs5[5] - 1/12.) < 1e-14 );
+    REQUIRE( abs_(coeffs5[8] - 2/3.) < 1e-14 );
+    REQUIRE( abs_(coeffs5[12] + 5/2.) < 1e-14 );
+
+    std::vector<double> grid(40);
+    for (unsigned i=0; i < grid.size(); ++i)
+        grid[i] = i*0.1 + 0.1*std::sin(i);
+    for (double around : {grid[17], grid[17] + 1e-13, 1.234}){
+        auto ref = finitediff::generate_weights(grid, 3, around);
+        auto res = finitediff::generate_weights(grid, 3, around, finitediff::WeightsEngine::barycentric);
+        REQUIRE( ref.size() == res.size() );
+        for (unsigned i=0; i < ref.size(); ++i)
+            REQUIRE( abs_(ref[i] - res[i]) < 1e-8*(1 + abs_(ref[i])) );
+    }
+}
+
+// the C and C++ dispatch between weights and direct evaluation alike
+static_assert(finitediff::direct_min_points == FINITEDIFF_DIRECT_MIN_POINTS_PER_SET, "direct_min_points");
+static_assert(finitediff::direct_max_work == FINITEDIFF_DIRECT_MAX_WORK, "direct_max_work");
+
+TEST_CASE( "apply_fd direct", "finitediff::apply_fd_direct") {
+    std::vector<double> grid(11), y(11), w(11*4), ref(4), out(4), work(11 + 2*4);
+    for (unsigned i=0; i < grid.size(); ++i){
+        grid[i] = 0.1*i + 0.02*std::sin(3.0*i);
+        y[i] = std::exp(grid[i]);
+    }
+    for (double around : {grid[0], grid[4], 0.55, 1.2}){
+        finitediff::calculate_weights<double>(&grid[0], 11, 3, &w[0], around);
+        for (unsigned k=0; k < 4; ++k){
+            ref[k] = 0;
+            for (unsigned i=0; i < 11; ++i)
+                ref[k] += w[i + k*11]*y[i];
+        }
+        finitediff::apply_fd_direct<double>(11, 3, &grid[0], &y[0], around, &out[0], &work[0]);
+        for (unsigned k=0; k < 4; ++k)
+            REQUIRE( abs_(out[k] - ref[k]) < std::pow(10.0, k - 9.0)*(1 + abs_(ref[k])) );
+        finitediff::apply_fd<double>(11, 3, &grid[0], &y[0], around, &out[0]);
+        REQUIRE( abs_(out[2] - ref[2]) < 1e-7*(1 + abs_(ref[2])) );
+    }
+}
+
+TEST_CASE( "periodic", "finitediff::apply_fd_periodic") {
+    const double period = 2*3.141592653589793;
+    std::vector<double> grid(24), y(24), out(3);
+    for (unsigned i=0; i < grid.size(); ++i){
+        grid[i] = period*(i + 0.3*std::sin(i))/grid.size();
+        y[i] = std::sin(grid[i]);
+    }
+    for (double x : {-7.0, -0.01, 0.0, 0.02, 3.0, 6.25, 13.0}){
+        finitediff::apply_fd_periodic<double>(&grid[0], grid.size(), period, &y[0], x, 3, 3, 2, &out[0]);
+        REQUIRE( abs_(out[0] - std::sin(x)) < 1e-5 );
+        REQUIRE( abs_(out[1] - std::cos(x)) < 1e-4 );
+        REQUIRE( abs_(out[2] + std::sin(x)) < 1e-2 );
+    }
+    REQUIRE_THROWS( finitediff::apply_fd_periodic<double>(&grid[0], grid.size(), 1.0, &y[0], 0.0, 3, 3, 2, &out[0]) );
+    // targets one period apart (reduction of x0 +/- period is inexact for these offsets x0)
+    for (double x0 : {0.1, 2.069}){
+        std::vector<double> sgrid(grid), ref(3);
+        for (auto& g : sgrid)
+            g += x0;
+        finitediff::apply_fd_periodic<double>(&sgrid[0], sgrid.size(), period, &y[0], x0, 3, 3, 2, &ref[0]);
+        for (double x : {x0 + period, x0 - period}){
+            finitediff::apply_fd_periodic<double>(&sgrid[0], sgrid.size(), period, &y[0], x, 3, 3, 2, &out[0]);
+            for (unsigned j=0; j < 3; ++j)
+                REQUIRE( abs_(out[j] - ref[j]) < 1e-12 );
+        }
+    }
+}
+
+TEST_CASE( "differentiate on grid", "finitediff::differentiate_on_grid") {
+    // uniform with a stretched middle part, cubic polynomial is differentiated exactly by 5 point stencils
+    std::vector<double> grid(60), y(60), out(3*60);
+    for (unsigned i=0; i < grid.size(); ++i)
+        grid[i] = (i < 20) ? 0.1*i : ((i < 40) ? 2 + 0.1*(i-20)*(1 + 0.05*(i-20)) : 6 + 0.2*(i-40));
+    for (unsigned i=0; i < grid.size(); ++i)
+        y[i] = 1 + grid[i]*(2 + grid[i]*(3 - grid[i]));
+    finitediff::differentiate_on_grid(&grid[0], grid.size(), &y[0], 1, grid.size(), 2, 5, &out[0]);
+    for (unsigned i=0; i < grid.size(); ++i){
+        const double x = grid[i];
+        REQUIRE( abs_(out[i] - y[i]) < 1e-10 );
+        REQUIRE( abs_(out[60 + i] - (2 + 6*x - 3*x*x)) < 1e-8 );
+        REQUIRE( abs_(out[120 + i] - (6 - 6*x)) < 1e-6 );
+    }
+    REQUIRE_THROWS( finitediff::differentiate_on_grid(&grid[0], grid.size(), &y[0], 1, grid.size(), 2, 2, &out[0]) );
+}
+
 
 std::pair<std::vector<double>, std::vector<double>> get_ref_out_(std::vector<double> grid,
                                                                  const double x, const unsigned maxord){